@@ -1,16 +1,15 @@
 #include "BoneAnimation.hpp"
 
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
 
-#include <fstream>
+#include <iostream>
 
 kit::BoneAnimation::BoneAnimation(std::string const &filename) {
 	std::cout << "Reading bone-based animation from '" << filename << "'." << std::endl;
 
-	std::ifstream file(filename, std::ios::binary);
+	ChunkFile file(filename);
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	auto strings = file.read< char >("str0");
 
 	{ //read bones:
 		struct BoneInfo {
@@ -20,8 +19,7 @@ kit::BoneAnimation::BoneAnimation(std::string const &filename) {
 		};
 		static_assert(sizeof(BoneInfo) == 4*2 + 4 + 4*12, "BoneInfo is packed.");
 
-		std::vector< BoneInfo > file_bones;
-		read_chunk(file, "bon0", &file_bones);
+		auto file_bones = file.read< BoneInfo >("bon0");
 		bones.reserve(file_bones.size());
 		for (auto const &file_bone : file_bones) {
 			if (!(file_bone.name_begin <= file_bone.name_end && file_bone.name_end <= strings.size())) {
@@ -32,14 +30,17 @@ kit::BoneAnimation::BoneAnimation(std::string const &filename) {
 			}
 			bones.emplace_back();
 			Bone &bone = bones.back();
-			bone.name = std::string(&strings[0] + file_bone.name_begin, &strings[0] + file_bone.name_end);
+			bone.name = std::string(strings.data() + file_bone.name_begin, strings.data() + file_bone.name_end);
 			bone.parent = file_bone.parent;
 			bone.inverse_bind_matrix = file_bone.inverse_bind_matrix;
 		}
 	}
 
 	static_assert(sizeof(PoseBone) == 3*4 + 4*4 + 3*4, "PoseBone is packed.");
-	read_chunk(file, "frm0", &frame_bones);
+	{ //frames are kept after loading, so copy them out of the mapping:
+		auto file_frame_bones = file.read< PoseBone >("frm0");
+		frame_bones.assign(file_frame_bones.begin(), file_frame_bones.end());
+	}
 	if (frame_bones.size() % bones.size() != 0) {
 		throw std::runtime_error("frame bones is not divisible by bones");
 	}
@@ -53,8 +54,7 @@ kit::BoneAnimation::BoneAnimation(std::string const &filename) {
 		};
 		static_assert(sizeof(AnimationInfo) == 4*2 + 4*2, "AnimationInfo is packed.");
 
-		std::vector< AnimationInfo > file_animations;
-		read_chunk(file, "act0", &file_animations);
+		auto file_animations = file.read< AnimationInfo >("act0");
 		animations.reserve(file_animations.size());
 		for (auto const &file_animation : file_animations) {
 			if (!(file_animation.name_begin <= file_animation.name_end && file_animation.name_end <= strings.size())) {
@@ -65,7 +65,7 @@ kit::BoneAnimation::BoneAnimation(std::string const &filename) {
 			}
 			animations.emplace_back();
 			Animation &animation = animations.back();
-			animation.name = std::string(&strings[0] + file_animation.name_begin, &strings[0] + file_animation.name_end);
+			animation.name = std::string(strings.data() + file_animation.name_begin, strings.data() + file_animation.name_end);
 			animation.begin = file_animation.begin;
 			animation.end = file_animation.end;
 		}
@@ -73,8 +73,7 @@ kit::BoneAnimation::BoneAnimation(std::string const &filename) {
 
 	{ //read actual mesh:
 		GLAttribBuffer< glm::vec3, glm::vec3, glm::u8vec4, glm::vec2, glm::vec4, glm::uvec4 > buffer;
-		std::vector< decltype(buffer)::Vertex > data;
-		read_chunk(file, "msh0", &data);
+		auto data = file.read< decltype(buffer)::Vertex >("msh0");
 
 		//check bone indices:
 		for (auto const &vertex : data) {
@@ -98,7 +97,7 @@ kit::BoneAnimation::BoneAnimation(std::string const &filename) {
 		}
 
 		//upload data:
-		buffer.set(data, GL_STATIC_DRAW);
+		buffer.set(data.size(), data.data(), GL_STATIC_DRAW);
 		vertex_count = data.size();
 
 		Position = buffer[0];
@@ -0,0 +1,224 @@
+#include "ChunkFile.hpp"
+#include "read_chunk.hpp"
+#include "load_stats.hpp"
+
+#include <limits>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	uint32_t magic_key(char const *magic) {
+		uint32_t key;
+		std::memcpy(&key, magic, 4);
+		return key;
+	}
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+}
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open chunk file '" + filename + "'.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of chunk file '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	file_handle = file;
+	if (size == 0) return; //can't map an empty file
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map chunk file '" + filename + "'.");
+	}
+	mapping_handle = mapping;
+	data = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map chunk file '" + filename + "'.");
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open chunk file '" + filename + "'.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of chunk file '" + filename + "'.");
+	}
+	size = size_t(st.st_size);
+	if (size == 0) { //can't map an empty file
+		close(fd);
+		return;
+	}
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //mapping stays valid after close
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map chunk file '" + filename + "'.");
+	}
+	//chunks are generally read front-to-back:
+	madvise(mapped, size, MADV_SEQUENTIAL);
+	data = reinterpret_cast< char const * >(mapped);
+	#endif
+
+	end = size;
+	//(the destructor won't run if the constructor throws, so release the mapping here)
+	try {
+		read_toc();
+	} catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+ChunkFile::~ChunkFile() {
+	unmap();
+}
+
+void ChunkFile::unmap() {
+	#if defined(_WIN32)
+	if (data) UnmapViewOfFile(data);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	mapping_handle = file_handle = nullptr;
+	#else
+	if (data) munmap(const_cast< char * >(data), size);
+	#endif
+	data = nullptr;
+}
+
+ChunkFile::Header ChunkFile::parse_header(size_t at) const {
+	if (end - at < sizeof(ChunkHeader)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	ChunkHeader chunk_header;
+	std::memcpy(&chunk_header, data + at, sizeof(chunk_header));
+
+	Header header;
+	header.magic = data + at;
+	header.header_size = sizeof(chunk_header);
+	if (chunk_header.size != ChunkSizeWide && chunk_header.size != ChunkSizeDeflated) {
+		header.stored = header.size = chunk_header.size;
+	} else {
+		//wide and compressed chunks are followed by a 64-bit size:
+		uint64_t size = 0;
+		if (end - at - header.header_size < sizeof(size)) {
+			throw std::runtime_error("Failed to read wide chunk header");
+		}
+		std::memcpy(&size, data + at + header.header_size, sizeof(size));
+		header.header_size += sizeof(size);
+		if (size > std::numeric_limits< size_t >::max()) {
+			throw std::runtime_error("Chunk too large to map");
+		}
+		header.stored = header.size = size_t(size);
+
+		//compressed chunks also record the size of their compressed data:
+		if (chunk_header.size == ChunkSizeDeflated) {
+			uint64_t stored = 0;
+			if (end - at - header.header_size < sizeof(stored)) {
+				throw std::runtime_error("Failed to read compressed chunk header");
+			}
+			std::memcpy(&stored, data + at + header.header_size, sizeof(stored));
+			header.header_size += sizeof(stored);
+			if (stored > std::numeric_limits< size_t >::max()) {
+				throw std::runtime_error("Chunk too large to map");
+			}
+			header.stored = size_t(stored);
+			header.deflated = true;
+		}
+	}
+	if (end - at - header.header_size < header.stored) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	return header;
+}
+
+std::string ChunkFile::peek_magic() const {
+	if (offset == end) return "";
+	return std::string(parse_header(offset).magic, 4);
+}
+
+ChunkFile::Header ChunkFile::read_header(std::string const &magic) {
+	assert(magic.size() == 4);
+
+	Header header = parse_header(offset);
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+	offset += header.header_size;
+	kit::count_bytes_read(header.header_size + header.stored);
+	return header;
+}
+
+void ChunkFile::inflate(Header const &header, char *to) {
+	assert(header.deflated);
+	inflate_chunk_blocks(data + offset, header.stored, to, header.size);
+	offset += header.stored;
+}
+
+void ChunkFile::read_toc() {
+	struct TOCFooter {
+		ChunkHeader header;
+		uint64_t offset = 0;
+	};
+	static_assert(sizeof(TOCFooter) == 16, "toc footer is packed");
+
+	if (size < sizeof(TOCFooter)) return;
+	TOCFooter footer;
+	std::memcpy(&footer, data + size - sizeof(TOCFooter), sizeof(TOCFooter));
+	if (std::string(footer.header.magic,4) != "tocp" || footer.header.size != sizeof(footer.offset)) return;
+	if (footer.offset > size - sizeof(TOCFooter)) {
+		throw std::runtime_error("Table of contents offset in '" + filename + "' is out of range.");
+	}
+
+	size_t old_offset = offset;
+	offset = footer.offset;
+	ChunkView< ChunkTOCEntry > toc = read< ChunkTOCEntry >("toc0");
+	offset = old_offset;
+
+	for (auto const &entry : toc) {
+		if (entry.offset > footer.offset) {
+			throw std::runtime_error("Chunk offset in table of contents of '" + filename + "' is out of range.");
+		}
+		chunks.emplace(magic_key(entry.magic), entry.offset);
+	}
+	end = footer.offset;
+	indexed = true;
+}
+
+void ChunkFile::build_index() {
+	assert(!indexed);
+	size_t at = 0;
+	while (at < end) {
+		Header header = parse_header(at);
+		chunks.emplace(magic_key(header.magic), at);
+		at += header.header_size + header.stored;
+	}
+	indexed = true;
+}
+
+bool ChunkFile::seek(std::string const &magic) {
+	assert(magic.size() == 4);
+	if (!indexed) build_index();
+	auto f = chunks.find(magic_key(magic.data()));
+	if (f == chunks.end()) return false;
+	offset = f->second;
+	return true;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+/*
+ * ChunkFile memory-maps a file of chunks (as written by write_chunk) and
+ *  hands out typed views of the chunk contents without copying them.
+ *
+ * Chunks are read in order, just like with read_chunk():
+ *
+ *   ChunkFile file(filename);
+ *   ChunkView< Vertex > data = file.read< Vertex >("pnct");
+ *   ChunkView< char > strings = file.read< char >("str0");
+ *
+ * Chunks can also be looked up by magic number, in any order:
+ *
+ *   ChunkView< IndexEntry > index = file.lookup< IndexEntry >("idx0");
+ *
+ * This uses the file's table of contents (see read_chunk.hpp) if it has one,
+ *  and otherwise indexes the file by walking its chunk headers.
+ * Since pages of the mapping are only read when touched, looking up a few chunks
+ *  in a large file only reads those chunks from disk.
+ *
+ * Views point into the mapping, so they are only valid while the ChunkFile is alive.
+ * (If a chunk's data isn't suitably aligned for T, or the chunk is compressed,
+ *  the view holds a copy instead.)
+ */
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+template< typename T >
+struct ChunkView {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk data must be trivially copyable");
+
+	ChunkView() = default;
+	ChunkView(ChunkView const &) = delete;
+	ChunkView(ChunkView &&) = default;
+	ChunkView &operator=(ChunkView &&) = default;
+
+	T const *data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+
+	T const *begin() const { return data_; }
+	T const *end() const { return data_ + size_; }
+	T const &operator[](size_t i) const { assert(i < size_); return data_[i]; }
+
+	//internals:
+	T const *data_ = nullptr;
+	size_t size_ = 0;
+	std::vector< T > copy; //only used when the mapped data was misaligned
+};
+
+struct ChunkFile {
+	//map a file; throws if the file can't be opened or mapped:
+	ChunkFile(std::string const &filename);
+	~ChunkFile();
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	//read the next chunk as an array of T; throws on wrong magic or bad size:
+	template< typename T >
+	ChunkView< T > read(std::string const &magic);
+
+	//read the next chunk as a single T; throws on wrong magic or bad size:
+	template< typename T >
+	void read_struct(std::string const &magic, T *to);
+
+	//move the read position to the chunk with the given magic number:
+	// returns false if there is no such chunk
+	bool seek(std::string const &magic);
+
+	//read the chunk with the given magic number (wherever it is); throws if it doesn't exist:
+	template< typename T >
+	ChunkView< T > lookup(std::string const &magic) {
+		if (!seek(magic)) {
+			throw std::runtime_error("Chunk '" + magic + "' does not exist in '" + filename + "'.");
+		}
+		return read< T >(magic);
+	}
+
+	//magic number of the next chunk (or "" if all chunk data has been read):
+	std::string peek_magic() const;
+
+	//has all chunk data been read? (ignores any table of contents at the end)
+	bool at_end() const { return offset == end; }
+
+	std::string filename;
+	char const *data = nullptr; //mapped file contents
+	size_t size = 0; //size of mapping
+	size_t offset = 0; //current read position
+	size_t end = 0; //end of chunk data (== start of table of contents, if present)
+
+	//internals:
+	struct Header {
+		char const *magic = nullptr;
+		size_t header_size = 0; //bytes in the header itself
+		size_t stored = 0; //bytes following the header
+		size_t size = 0; //bytes of chunk data (after decompression)
+		bool deflated = false; //is the chunk compressed? (see read_chunk.hpp)
+	};
+	//parse the chunk header at 'at':
+	Header parse_header(size_t at) const;
+	//read the next chunk header and check magic; leaves offset at the start of the chunk's data:
+	Header read_header(std::string const &magic);
+	//decompress the (compressed) chunk data at offset into 'to' and advance offset past it:
+	void inflate(Header const &header, char *to);
+	//chunk header offsets, by magic number (first chunk with each magic wins):
+	std::unordered_map< uint32_t, size_t > chunks;
+	bool indexed = false; //has 'chunks' been filled in?
+	void read_toc(); //fill 'chunks' from the table of contents, if there is one
+	void build_index(); //fill 'chunks' by walking headers
+	void unmap(); //release the mapping (and, on Windows, the file handles)
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
+
+template< typename T >
+ChunkView< T > ChunkFile::read(std::string const &magic) {
+	Header header = read_header(magic);
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	ChunkView< T > view;
+	view.size_ = header.size / sizeof(T);
+	if (header.deflated) {
+		view.copy.resize(view.size_);
+		inflate(header, reinterpret_cast< char * >(view.copy.data()));
+		view.data_ = view.copy.data();
+		return view;
+	}
+	char const *at = data + offset;
+	if (reinterpret_cast< uintptr_t >(at) % alignof(T) == 0) {
+		view.data_ = reinterpret_cast< T const * >(at);
+	} else {
+		view.copy.resize(view.size_);
+		if (header.size) std::memcpy(view.copy.data(), at, header.size);
+		view.data_ = view.copy.data();
+	}
+	offset += header.stored;
+	return view;
+}
+
+template< typename T >
+void ChunkFile::read_struct(std::string const &magic, T *to) {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk data must be trivially copyable");
+	assert(to);
+	Header header = read_header(magic);
+	if (header.size != sizeof(T)) {
+		throw std::runtime_error("Size of chunk not struct size");
+	}
+	if (header.deflated) {
+		inflate(header, reinterpret_cast< char * >(to));
+		return;
+	}
+	std::memcpy(to, data + offset, sizeof(T));
+	offset += header.stored;
+}
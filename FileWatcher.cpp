@@ -0,0 +1,72 @@
+#include "FileWatcher.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace kit {
+
+FileWatcher::FileWatcher() {
+	#if defined(__linux__)
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		std::cerr << "WARNING: inotify_init1 failed (" << std::strerror(errno) << "); file changes won't be noticed." << std::endl;
+	}
+	#else
+	std::cerr << "WARNING: FileWatcher isn't implemented on this platform; file changes won't be noticed." << std::endl;
+	#endif
+}
+
+FileWatcher::~FileWatcher() {
+	#if defined(__linux__)
+	if (fd >= 0) close(fd);
+	#endif
+}
+
+void FileWatcher::watch(std::string const &path) {
+	if (!watched.insert(path).second) return;
+	#if defined(__linux__)
+	if (fd < 0) return;
+	auto slash = path.find_last_of('/');
+	std::string directory = (slash == std::string::npos ? "." : path.substr(0, slash));
+	int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd < 0) {
+		std::cerr << "WARNING: failed to watch '" << directory << "' (" << std::strerror(errno) << ")." << std::endl;
+		return;
+	}
+	//(adding a watch on an already-watched directory returns the same descriptor)
+	directories[wd] = directory;
+	#endif
+}
+
+std::vector< std::string > FileWatcher::poll() {
+	std::vector< std::string > changed;
+	#if defined(__linux__)
+	if (fd < 0) return changed;
+	alignas(inotify_event) char buffer[4096];
+	while (true) {
+		ssize_t got = read(fd, buffer, sizeof(buffer));
+		if (got <= 0) break; //(EAGAIN when there are no more events)
+		for (char const *at = buffer; at < buffer + got; ) {
+			inotify_event const *event = reinterpret_cast< inotify_event const * >(at);
+			at += sizeof(inotify_event) + event->len;
+			auto f = directories.find(event->wd);
+			if (f == directories.end() || event->len == 0) continue;
+			std::string path = f->second + "/" + event->name; //(name is null-padded)
+			if (!watched.count(path)) continue;
+			if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+				changed.emplace_back(path);
+			}
+		}
+	}
+	#endif
+	return changed;
+}
+
+}
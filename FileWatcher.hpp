@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * FileWatcher reports files that have been rewritten (or replaced) since it was last polled:
+ *
+ *   kit::FileWatcher watcher;
+ *   watcher.watch(kit::data_path("level.pnct"));
+ *   ...each frame:
+ *   for (auto const &path : watcher.poll()) { ...reload path... }
+ *
+ * Watches the containing directory, so files replaced by rename (as many editors and
+ *  exporters do) are reported too.
+ *
+ * Only implemented on Linux (with inotify); elsewhere, poll() never reports anything.
+ */
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace kit {
+
+struct FileWatcher {
+	FileWatcher();
+	~FileWatcher();
+	FileWatcher(FileWatcher const &) = delete;
+	FileWatcher &operator=(FileWatcher const &) = delete;
+
+	//start watching a file (does nothing if already watched):
+	void watch(std::string const &path);
+
+	//paths (as passed to watch()) changed since the last call; doesn't block:
+	std::vector< std::string > poll();
+
+	//internals:
+	int fd = -1;
+	std::unordered_map< int, std::string > directories; //watch descriptor -> directory
+	std::unordered_set< std::string > watched;
+};
+
+}
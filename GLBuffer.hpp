@@ -12,6 +12,7 @@
 #include "gl.hpp"
 
 #include "GLTypeInfo.hpp"
+#include "load_stats.hpp"
 
 #include <glm/glm.hpp>
 
@@ -30,6 +31,7 @@ struct GLBuffer {
 	void set(GLenum target, GLsizeiptr size, GLvoid const *data, GLenum usage) {
 		glBindBuffer(target, buffer);
 		glBufferData(target, size, data, usage);
+		kit::count_gpu_bytes(size);
 	}
 };
 
@@ -6,11 +6,15 @@
  */
 
 #include "gl.hpp"
+#include "load_stats.hpp"
+#include "load_save_png.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <vector>
+#include <stdexcept>
+#include <cassert>
 
 struct GLTexture {
 	GLuint texture = 0;
@@ -25,6 +29,47 @@ struct GLTexture {
 		assert(size.x * size.y == data.size());
 		glBindTexture(GL_TEXTURE_2D, texture);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, glm::value_ptr(data[0]));
+		kit::count_gpu_bytes(uint64_t(size.x) * size.y * 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	//helper to call TexImage with any format (rows of 'data' must be tightly packed):
+	void set(glm::uvec2 size, GLenum internal_format, GLenum format, GLenum type, void const *data, uint64_t bytes) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		//rows of, e.g., R8 or RGB8 data aren't padded to four bytes:
+		GLint alignment = 4;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, size.x, size.y, 0, format, type, data);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+		kit::count_gpu_bytes(bytes);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	//upload a png in its own format (GL_R8, GL_RG8, GL_RGB8, GL_RGBA8, or the 16-bit versions):
+	// gray images are swizzled so shaders sample them as (g,g,g,1) and gray+alpha as (g,g,g,a), just as
+	// they would if expanded to RGBA -- so alpha is only in .a (the swizzle doesn't apply to, e.g., image loads).
+	void set(PNGImage const &image) {
+		assert(image.data.size() == size_t(image.width) * image.height * image.pixel_bytes());
+		static GLenum const Formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		static GLenum const InternalFormats8[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+		static GLenum const InternalFormats16[4] = { GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 };
+		if (image.channels < 1 || image.channels > 4 || (image.bit_depth != 8 && image.bit_depth != 16)) {
+			throw std::runtime_error("Unexpected png format (" + std::to_string(image.channels) + " channels, " + std::to_string(image.bit_depth) + " bits).");
+		}
+		uint32_t c = image.channels - 1;
+		set(glm::uvec2(image.width, image.height),
+			(image.bit_depth == 16 ? InternalFormats16[c] : InternalFormats8[c]),
+			Formats[c],
+			(image.bit_depth == 16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE),
+			image.data.data(), image.data.size());
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		bool gray = (image.channels <= 2);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, (gray ? GL_RED : GL_GREEN));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, (gray ? GL_RED : GL_BLUE));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, (image.channels == 2 ? GL_GREEN : image.channels == 1 ? GL_ONE : GL_ALPHA));
 		glBindTexture(GL_TEXTURE_2D, 0);
 	}
 };
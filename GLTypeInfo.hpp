@@ -4,6 +4,12 @@
 
 #include <glm/glm.hpp>
 
+//Packed attribute types (no matching glm type; fill using glm/gtc/packing.hpp):
+struct GLHalf2 { uint16_t x, y; }; //from glm::packHalf1x16 (or glm::packHalf2x16)
+struct GLHalf4 { uint16_t x, y, z, w; }; //from glm::packHalf1x16 (or glm::packHalf4x16)
+struct GLSNorm3x10_1x2 { uint32_t packed; }; //from glm::packSnorm3x10_1x2
+static_assert(sizeof(GLHalf4) == 8, "GLHalf4 is packed.");
+
 //Traits struct that stores GL info about c++/glm types:
 template< typename T >
 struct GLTypeInfo;
@@ -33,6 +39,21 @@ SPECIALIZE( glm::u8vec2, 2, GL_UNSIGNED_BYTE, KIT_NORMALIZED_AS_FLOAT );
 SPECIALIZE( glm::u8vec3, 3, GL_UNSIGNED_BYTE, KIT_NORMALIZED_AS_FLOAT );
 SPECIALIZE( glm::u8vec4, 4, GL_UNSIGNED_BYTE, KIT_NORMALIZED_AS_FLOAT );
 
+SPECIALIZE( uint16_t, 1, GL_UNSIGNED_SHORT, KIT_NORMALIZED_AS_FLOAT );
+SPECIALIZE( glm::u16vec2, 2, GL_UNSIGNED_SHORT, KIT_NORMALIZED_AS_FLOAT );
+SPECIALIZE( glm::u16vec3, 3, GL_UNSIGNED_SHORT, KIT_NORMALIZED_AS_FLOAT );
+SPECIALIZE( glm::u16vec4, 4, GL_UNSIGNED_SHORT, KIT_NORMALIZED_AS_FLOAT );
+
+SPECIALIZE( int16_t, 1, GL_SHORT, KIT_NORMALIZED_AS_FLOAT );
+SPECIALIZE( glm::i16vec2, 2, GL_SHORT, KIT_NORMALIZED_AS_FLOAT );
+SPECIALIZE( glm::i16vec3, 3, GL_SHORT, KIT_NORMALIZED_AS_FLOAT );
+SPECIALIZE( glm::i16vec4, 4, GL_SHORT, KIT_NORMALIZED_AS_FLOAT );
+
+SPECIALIZE( GLHalf2, 2, GL_HALF_FLOAT, KIT_AS_FLOAT );
+SPECIALIZE( GLHalf4, 4, GL_HALF_FLOAT, KIT_AS_FLOAT );
+
+SPECIALIZE( GLSNorm3x10_1x2, 4, GL_INT_2_10_10_10_REV, KIT_NORMALIZED_AS_FLOAT );
+
 SPECIALIZE( uint32_t, 1, GL_UNSIGNED_INT, KIT_AS_INTEGER );
 SPECIALIZE( glm::uvec2, 2, GL_UNSIGNED_INT, KIT_AS_INTEGER );
 SPECIALIZE( glm::uvec3, 3, GL_UNSIGNED_INT, KIT_AS_INTEGER );
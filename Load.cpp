@@ -1,32 +1,709 @@
 #include "Load.hpp"
+#include "ThreadPool.hpp"
+#include "load_stats.hpp"
+#include "FileWatcher.hpp"
 
 #include <array>
 #include <list>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
 #include <cassert>
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 namespace kit {
 
 namespace {
-	std::array< std::list< std::function< void() > >, LoadTagCount > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, LoadTagCount > load_lists;
+	std::array< std::list< LoadFunction >, LoadTagCount > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, LoadTagCount > load_lists;
 		return load_lists;
 	}
+	//keys of functions that have already been called:
+	std::unordered_set< void const * > &get_finished_keys() {
+		static std::unordered_set< void const * > finished_keys;
+		return finished_keys;
+	}
+	std::vector< LoadReport > &get_load_reports() {
+		static std::vector< LoadReport > load_reports;
+		return load_reports;
+	}
+	//(lazy loads may finish on any thread)
+	std::mutex &get_load_reports_mutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+	void record_load_report(LoadReport const &report) {
+		std::unique_lock< std::mutex > lock(get_load_reports_mutex());
+		get_load_reports().emplace_back(report);
+	}
+
+	//lazy loads by key (so they can find their dependencies whatever order they were constructed in):
+	struct LazyLoads {
+		std::mutex mutex;
+		std::unordered_map< void const *, std::weak_ptr< LazyLoad > > by_key;
+	};
+	LazyLoads &get_lazy_loads() {
+		static LazyLoads lazy_loads;
+		return lazy_loads;
+	}
+
+	//CPU time used by the calling thread, in seconds:
+	double thread_cpu_seconds() {
+		#if defined(_WIN32)
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0.0;
+		auto ticks = [](FILETIME const &ft) {
+			return (uint64_t(ft.dwHighDateTime) << 32) | uint64_t(ft.dwLowDateTime);
+		};
+		return double(ticks(kernel) + ticks(user)) * 1e-7; //(FILETIME ticks are 100ns)
+		#else
+		timespec ts;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0.0;
+		return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+		#endif
+	}
+
+	//run fn() on the calling thread, adding its costs to 'report':
+	template< typename F >
+	auto measure(LoadReport *report, F const &fn) -> decltype(fn()) {
+		struct Sample {
+			Sample() : wall(std::chrono::steady_clock::now()), cpu(thread_cpu_seconds()), counters(load_counters()) { }
+			std::chrono::steady_clock::time_point wall;
+			double cpu;
+			LoadCounters counters;
+		};
+		struct Accumulate { //(so costs are recorded even if fn throws)
+			LoadReport *report;
+			Sample before;
+			std::vector< std::string > *outer_files = load_files();
+			Accumulate(LoadReport *report_, Sample const &before_) : report(report_), before(before_) {
+				load_files() = &report->files;
+			}
+			~Accumulate() {
+				load_files() = outer_files;
+				Sample after;
+				report->wall_seconds += std::chrono::duration< double >(after.wall - before.wall).count();
+				report->cpu_seconds += after.cpu - before.cpu;
+				report->bytes_read += after.counters.bytes_read - before.counters.bytes_read;
+				report->gpu_bytes += after.counters.gpu_bytes - before.counters.gpu_bytes;
+			}
+		} accumulate(report, Sample());
+		return fn();
+	}
+
+	//hot reload state:
+	bool hot_reload_enabled() {
+		static bool enabled = (std::getenv("KIT_HOT_RELOAD") != nullptr);
+		return enabled;
+	}
+	struct Reloadable {
+		LoadTag tag;
+		LoadFunction fn;
+		std::vector< std::string > files; //data files it opened last time it ran
+	};
+	struct HotReload {
+		std::unique_ptr< FileWatcher > watcher;
+		std::vector< Reloadable > loads; //in the order they finished (so dependencies come first)
+		std::unordered_set< std::string > changed; //changed files not yet reloaded
+		bool reloading = false;
+	};
+	HotReload &get_hot_reload() {
+		static HotReload hot_reload;
+		return hot_reload;
+	}
+
+	void watch_files(Reloadable *load_, std::vector< std::string > const &files) {
+		assert(load_);
+		auto &load = *load_;
+		auto &hot_reload = get_hot_reload();
+		if (!hot_reload.watcher) hot_reload.watcher.reset(new FileWatcher());
+		load.files.clear();
+		for (auto const &file : files) {
+			if (std::find(load.files.begin(), load.files.end(), file) != load.files.end()) continue;
+			load.files.emplace_back(file);
+			hot_reload.watcher->watch(file);
+		}
+	}
+
+	void remember_for_reload(LoadTag tag, LoadFunction const &fn, std::vector< std::string > const &files) {
+		auto &hot_reload = get_hot_reload();
+		hot_reload.loads.emplace_back();
+		hot_reload.loads.back().tag = tag;
+		hot_reload.loads.back().fn = fn;
+		watch_files(&hot_reload.loads.back(), files);
+	}
+
+	//call a batch of functions (all with the same tag), using worker threads where possible:
+	void call_batch(LoadTag tag, std::vector< LoadFunction > const &batch) {
+		auto &finished_keys = get_finished_keys();
+
+		std::vector< LoadReport > reports(batch.size());
+		for (size_t i = 0; i < batch.size(); ++i) {
+			reports[i].label = batch[i].label;
+			reports[i].tag = tag;
+		}
+
+		//build dependency graph:
+		std::vector< uint32_t > waiting(batch.size(), 0); //number of unfinished dependencies
+		std::vector< std::vector< size_t > > dependents(batch.size());
+		{
+			std::unordered_map< void const *, size_t > key_index;
+			for (size_t i = 0; i < batch.size(); ++i) {
+				if (batch[i].key) key_index.emplace(batch[i].key, i);
+			}
+			auto depend = [&](size_t i, size_t dependency) {
+				dependents[dependency].emplace_back(i);
+				waiting[i] += 1;
+			};
+			size_t previous_main = batch.size();
+			for (size_t i = 0; i < batch.size(); ++i) {
+				assert(bool(batch[i].main) != bool(batch[i].worker));
+				for (void const *key : batch[i].dependencies) {
+					if (finished_keys.count(key)) continue;
+					auto f = key_index.find(key);
+					if (f == key_index.end()) {
+						throw std::runtime_error("Load depends on a Load with a later tag (or one that was never constructed).");
+					}
+					depend(i, f->second);
+				}
+				//main-thread-only functions run in the order they were added:
+				if (batch[i].main) {
+					if (previous_main < batch.size()) depend(i, previous_main);
+					previous_main = i;
+				}
+			}
+		}
+
+		//worker results come back through 'shared' (which the workers keep alive even if this function throws):
+		struct Completed {
+			size_t index;
+			std::function< void() > gl_fn;
+			std::exception_ptr error;
+			LoadReport report; //costs of the worker phase
+		};
+		struct Shared {
+			std::mutex mutex;
+			std::condition_variable cv;
+			std::deque< Completed > completed;
+		};
+		auto shared = std::make_shared< Shared >();
+
+		std::deque< size_t > ready_main; //main-thread functions that are ready to run
+		size_t in_flight = 0; //worker functions that have started but not returned
+		size_t done = 0;
+		std::exception_ptr error;
+
+		auto start = [&](size_t i) {
+			if (batch[i].worker) {
+				in_flight += 1;
+				auto worker = batch[i].worker;
+				thread_pool().run([shared,worker,i](){
+					Completed completed;
+					completed.index = i;
+					try {
+						completed.gl_fn = measure(&completed.report, worker);
+					} catch (...) {
+						completed.error = std::current_exception();
+					}
+					std::unique_lock< std::mutex > lock(shared->mutex);
+					shared->completed.emplace_back(std::move(completed));
+					shared->cv.notify_one();
+				});
+			} else {
+				ready_main.emplace_back(i);
+			}
+		};
+
+		auto finish = [&](size_t i) {
+			done += 1;
+			record_load_report(reports[i]);
+			if (hot_reload_enabled()) remember_for_reload(tag, batch[i], reports[i].files);
+			if (batch[i].key) finished_keys.insert(batch[i].key);
+			for (size_t d : dependents[i]) {
+				assert(waiting[d] > 0);
+				waiting[d] -= 1;
+				if (waiting[d] == 0) start(d);
+			}
+		};
+
+		//run a function on the main thread, remembering the first error:
+		auto call = [&](size_t i, std::function< void() > const &fn) {
+			try {
+				measure(&reports[i], fn);
+			} catch (...) {
+				error = std::current_exception();
+				return;
+			}
+			finish(i);
+		};
+
+		for (size_t i = 0; i < batch.size(); ++i) {
+			if (waiting[i] == 0) start(i);
+		}
+
+		while (true) {
+			//finish any worker functions that have returned (so their dependents can start):
+			std::deque< Completed > completed;
+			{
+				std::unique_lock< std::mutex > lock(shared->mutex);
+				if (ready_main.empty() || error) {
+					if (in_flight == 0) break;
+					shared->cv.wait(lock, [&shared](){ return !shared->completed.empty(); });
+				}
+				std::swap(completed, shared->completed);
+			}
+			for (auto &c : completed) {
+				assert(in_flight > 0);
+				in_flight -= 1;
+				reports[c.index].wall_seconds += c.report.wall_seconds;
+				reports[c.index].cpu_seconds += c.report.cpu_seconds;
+				reports[c.index].bytes_read += c.report.bytes_read;
+				reports[c.index].gpu_bytes += c.report.gpu_bytes;
+				reports[c.index].files.insert(reports[c.index].files.end(), c.report.files.begin(), c.report.files.end());
+				if (error) continue;
+				if (c.error) {
+					error = c.error;
+					continue;
+				}
+				call(c.index, c.gl_fn);
+			}
+
+			//run the next main-thread-only function:
+			if (!error && !ready_main.empty()) {
+				size_t i = ready_main.front();
+				ready_main.pop_front();
+				call(i, batch[i].main);
+			}
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		if (done != batch.size()) {
+			throw std::runtime_error("Load functions have circular dependencies.");
+		}
+	}
+
+	//re-runs a list of loads (indices into HotReload::loads), one after another:
+	struct ReloadJob {
+		std::vector< size_t > order;
+		size_t next = 0;
+		std::unordered_set< std::string > changed;
+		std::unordered_set< void const * > failed; //keys of loads that failed (or were skipped because a dependency did)
+	};
+
+	//start reloading job->order[job->next] (called on the main thread):
+	void continue_reload(std::shared_ptr< ReloadJob > job) {
+		auto &hot_reload = get_hot_reload();
+
+		//skip loads that depend on a failed one (they keep using its old value), but not the rest of the job:
+		size_t index;
+		while (true) {
+			if (job->next >= job->order.size()) {
+				hot_reload.reloading = false;
+				return;
+			}
+			index = job->order[job->next];
+			job->next += 1;
+			Reloadable const &load = hot_reload.loads[index];
+			bool skip = false;
+			for (void const *key : load.fn.dependencies) {
+				if (job->failed.count(key)) skip = true;
+			}
+			if (!skip) break;
+			std::cerr << "WARNING: not reloading '" << load.fn.label << "' because a dependency failed to reload." << std::endl;
+			if (load.fn.key) job->failed.insert(load.fn.key);
+		}
+
+		bool free_old = false; //only free old values of loads that opened a changed file (and that opted in; see Load.hpp)
+		for (auto const &file : hot_reload.loads[index].files) {
+			if (job->changed.count(file)) free_old = true;
+		}
+
+		auto report = std::make_shared< LoadReport >();
+		report->label = hot_reload.loads[index].fn.label;
+		report->tag = hot_reload.loads[index].tag;
+
+		//run the main-thread phase, swap in the new value, and move on to the next load:
+		auto finish = [job,index,report,free_old](std::function< void() > const &fn, std::exception_ptr error) {
+			auto &hot_reload = get_hot_reload();
+			Reloadable &load = hot_reload.loads[index];
+			if (!error) {
+				std::function< void(bool, bool) > end_reload;
+				if (load.fn.begin_reload) end_reload = load.fn.begin_reload();
+				try {
+					measure(report.get(), fn);
+				} catch (...) {
+					error = std::current_exception();
+				}
+				if (end_reload) end_reload(!error, free_old);
+			}
+			if (error) {
+				try {
+					std::rethrow_exception(error);
+				} catch (std::exception &e) {
+					std::cerr << "WARNING: failed to reload '" << load.fn.label << "' (keeping old version): " << e.what() << std::endl;
+				} catch (...) {
+					std::cerr << "WARNING: failed to reload '" << load.fn.label << "' (keeping old version)." << std::endl;
+				}
+				if (load.fn.key) job->failed.insert(load.fn.key);
+				continue_reload(job);
+				return;
+			}
+			watch_files(&load, report->files);
+			record_load_report(*report);
+			std::cout << "Reloaded '" << load.fn.label << "' in " << report->wall_seconds << " seconds." << std::endl;
+			continue_reload(job);
+		};
+
+		Reloadable const &load = hot_reload.loads[index];
+		if (load.fn.worker) {
+			auto worker = load.fn.worker;
+			thread_pool().run([worker,report,finish](){
+				std::function< void() > gl_fn;
+				std::exception_ptr error;
+				try {
+					gl_fn = measure(report.get(), worker);
+				} catch (...) {
+					error = std::current_exception();
+				}
+				post_main_thread([gl_fn,error,finish](){ finish(gl_fn, error); });
+			});
+		} else {
+			//(single-phase loads may make GL calls, so they run right here on the main thread)
+			finish(load.fn.main, nullptr);
+		}
+	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadLabel const &label) {
+	LoadFunction load_function;
+	load_function.label = label.name;
+	load_function.main = fn;
+	add_load_function(tag, load_function);
+}
+
+void add_load_function(LoadTag tag, LoadFunction const &fn) {
 	auto &load_lists = get_load_lists();
+	if (tag == LoadTagLazy || tag == LoadTagScoped) {
+		throw std::runtime_error("Only Load< T > supports LoadTagLazy and LoadTagScoped.");
+	}
 	assert(tag < load_lists.size());
 	load_lists[tag].emplace_back(fn);
 }
 
 void call_load_functions() {
 	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
+	auto before = std::chrono::steady_clock::now();
+	size_t first_report = get_load_reports().size();
+
+	for (uint32_t tag = 0; tag < load_lists.size(); ++tag) {
+		auto &fn_list = load_lists[tag];
+		//(functions may add more functions, so keep going until the list is empty)
 		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+			std::vector< LoadFunction > batch(fn_list.begin(), fn_list.end());
+			fn_list.clear();
+			call_batch(LoadTag(tag), batch);
+		}
+	}
+
+	if (char const *report = std::getenv("KIT_LOAD_REPORT")) {
+		double elapsed = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		std::string filename = report;
+		if (filename.size() >= 5 && filename.substr(filename.size() - 5) == ".json") {
+			std::ofstream out(filename);
+			write_load_reports_json(out);
+			if (!out) {
+				std::cerr << "WARNING: failed to write load report to '" << filename << "'." << std::endl;
+			}
+		} else {
+			print_load_reports(std::cout);
+			std::cout << "(" << (get_load_reports().size() - first_report) << " loads in " << elapsed << " seconds)" << std::endl;
 		}
 	}
 }
 
+void poll_hot_reload() {
+	if (!hot_reload_enabled()) return;
+	auto &hot_reload = get_hot_reload();
+	if (!hot_reload.watcher) return;
+	for (auto const &file : hot_reload.watcher->poll()) {
+		hot_reload.changed.insert(file);
+	}
+	if (hot_reload.reloading || hot_reload.changed.empty()) return;
+
+	//reload loads that opened changed files, along with everything that (eventually) depends on them:
+	auto job = std::make_shared< ReloadJob >();
+	std::swap(job->changed, hot_reload.changed);
+	std::unordered_set< void const * > reloaded_keys;
+	for (size_t i = 0; i < hot_reload.loads.size(); ++i) {
+		auto const &load = hot_reload.loads[i];
+		bool reload = false;
+		for (auto const &file : load.files) {
+			if (job->changed.count(file)) reload = true;
+		}
+		for (void const *key : load.fn.dependencies) {
+			if (reloaded_keys.count(key)) reload = true;
+		}
+		if (!reload) continue;
+		job->order.emplace_back(i);
+		if (load.fn.key) reloaded_keys.insert(load.fn.key);
+	}
+	if (job->order.empty()) return;
+
+	hot_reload.reloading = true;
+	continue_reload(job);
+}
+
+std::vector< LoadReport > const &load_reports() {
+	return get_load_reports();
+}
+
+void print_load_reports(std::ostream &to) {
+	std::vector< LoadReport > sorted = get_load_reports();
+	std::stable_sort(sorted.begin(), sorted.end(), [](LoadReport const &a, LoadReport const &b) {
+		return a.wall_seconds > b.wall_seconds;
+	});
+	char line[128];
+	std::snprintf(line, sizeof(line), "%10s %10s %12s %12s %4s  %s", "wall ms", "cpu ms", "read KiB", "gpu KiB", "tag", "label");
+	to << line << '\n';
+	for (auto const &report : sorted) {
+		std::snprintf(line, sizeof(line), "%10.2f %10.2f %12.1f %12.1f %4u  ",
+			report.wall_seconds * 1000.0, report.cpu_seconds * 1000.0,
+			report.bytes_read / 1024.0, report.gpu_bytes / 1024.0,
+			uint32_t(report.tag));
+		to << line << report.label << '\n';
+	}
+	to.flush();
+}
+
+void write_load_reports_json(std::ostream &to) {
+	auto quote = [](std::string const &str) {
+		std::string ret = "\"";
+		for (char c : str) {
+			if (c == '"' || c == '\\') {
+				ret += '\\';
+				ret += c;
+			} else if (uint8_t(c) < 0x20) {
+				char escape[8];
+				std::snprintf(escape, sizeof(escape), "\\u%04x", uint32_t(uint8_t(c)));
+				ret += escape;
+			} else {
+				ret += c;
+			}
+		}
+		ret += '"';
+		return ret;
+	};
+	to << "[\n";
+	auto const &reports = get_load_reports();
+	for (size_t i = 0; i < reports.size(); ++i) {
+		auto const &report = reports[i];
+		to << "\t{ \"label\": " << quote(report.label)
+		   << ", \"tag\": " << uint32_t(report.tag)
+		   << ", \"wall_seconds\": " << report.wall_seconds
+		   << ", \"cpu_seconds\": " << report.cpu_seconds
+		   << ", \"bytes_read\": " << report.bytes_read
+		   << ", \"gpu_bytes\": " << report.gpu_bytes
+		   << " }" << (i + 1 < reports.size() ? "," : "") << "\n";
+	}
+	to << "]\n";
+}
+
+void register_lazy_load(std::shared_ptr< LazyLoad > const &lazy) {
+	if (!lazy->fn.key) return;
+	auto &lazy_loads = get_lazy_loads();
+	std::unique_lock< std::mutex > lock(lazy_loads.mutex);
+	lazy_loads.by_key[lazy->fn.key] = lazy;
+}
+
+std::vector< std::shared_ptr< LazyLoad > > LazyLoad::lazy_dependencies() const {
+	std::vector< std::shared_ptr< LazyLoad > > dependencies;
+	if (fn.dependencies.empty()) return dependencies;
+	auto &lazy_loads = get_lazy_loads();
+	std::unique_lock< std::mutex > lock(lazy_loads.mutex);
+	for (void const *key : fn.dependencies) {
+		auto f = lazy_loads.by_key.find(key);
+		if (f == lazy_loads.by_key.end()) continue; //(not lazy, so already loaded by call_load_functions())
+		if (auto dependency = f->second.lock()) dependencies.emplace_back(dependency);
+	}
+	return dependencies;
+}
+
+void LazyLoad::prefetch() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		if (loaded || prefetching) return;
+		prefetching = true;
+	}
+
+	//the worker phase may use lazy dependencies, so it can only start once they have loaded:
+	bool waiting = false;
+	if (fn.worker) {
+		for (auto const &dependency : lazy_dependencies()) {
+			if (dependency->loaded) continue;
+			dependency->prefetch();
+			waiting = true;
+		}
+	}
+
+	auto self = shared_from_this();
+	if (fn.worker && !waiting) {
+		start_worker();
+	} else {
+		post_main_thread([self](){
+			//(skip the load if the last scope released it in the meantime)
+			bool wanted;
+			{
+				std::unique_lock< std::mutex > lock(self->mutex);
+				wanted = self->prefetching;
+			}
+			if (!wanted) return;
+			if (self->fn.worker) {
+				//(if a dependency fails, leave it to load() to report)
+				try {
+					for (auto const &dependency : self->lazy_dependencies()) {
+						dependency->load();
+					}
+				} catch (...) {
+					return;
+				}
+				self->start_worker();
+			} else {
+				self->load();
+			}
+		});
+	}
+}
+
+void LazyLoad::start_worker() {
+	std::unique_lock< std::mutex > lock(mutex);
+	if (loaded || !prefetching || prefetched.valid()) return;
+	auto self = shared_from_this();
+	auto promise = std::make_shared< std::promise< std::function< void() > > >();
+	prefetched = promise->get_future().share();
+	thread_pool().run([self,promise](){
+		LoadReport report;
+		std::function< void() > gl_fn;
+		std::exception_ptr error;
+		try {
+			gl_fn = measure(&report, self->fn.worker);
+		} catch (...) {
+			error = std::current_exception();
+		}
+		self->prefetch_report = report;
+		if (error) promise->set_exception(error);
+		else promise->set_value(gl_fn);
+	});
+}
+
+void LazyLoad::load_slow() {
+	//lazy dependencies load first (on this thread, so GL phases of main-thread loads stay there):
+	for (auto const &dependency : lazy_dependencies()) {
+		dependency->load();
+	}
+
+	std::unique_lock< std::mutex > lock(mutex);
+	if (loaded) return;
+
+	LoadReport report;
+	report.label = fn.label;
+	report.tag = tag;
+	if (fn.worker) {
+		std::function< void() > gl_fn;
+		if (prefetched.valid()) {
+			//(the prefetch is used up either way, so if it failed, the next load() or prefetch() tries again)
+			std::shared_future< std::function< void() > > result;
+			std::swap(result, prefetched);
+			prefetching = false;
+			gl_fn = result.get(); //(rethrows worker exceptions)
+			report.wall_seconds += prefetch_report.wall_seconds;
+			report.cpu_seconds += prefetch_report.cpu_seconds;
+			report.bytes_read += prefetch_report.bytes_read;
+			report.gpu_bytes += prefetch_report.gpu_bytes;
+			report.files = prefetch_report.files;
+		} else {
+			gl_fn = measure(&report, fn.worker);
+		}
+		measure(&report, gl_fn);
+	} else {
+		measure(&report, fn.main);
+	}
+	record_load_report(report);
+	loaded = true;
+}
+
+void LazyLoad::acquire() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		scopes += 1;
+	}
+	prefetch();
+}
+
+void LazyLoad::release() {
+	std::unique_lock< std::mutex > lock(mutex);
+	assert(scopes > 0);
+	scopes -= 1;
+	if (scopes > 0 || !free_value) return;
+
+	//wait for any in-flight worker phase (its result is discarded):
+	if (prefetched.valid()) prefetched.wait();
+	prefetched = std::shared_future< std::function< void() > >();
+	prefetching = false;
+
+	if (loaded) {
+		free_value();
+		loaded = false;
+	}
+}
+
+LoadScope::LoadScope(LoadDependencies const &loads) {
+	for (auto const &load : loads) {
+		if (!load.lazy) continue;
+		load.lazy->acquire();
+		held.emplace_back(load.lazy);
+	}
+}
+
+LoadScope::~LoadScope() {
+	for (auto const &lazy : held) {
+		lazy->release();
+	}
+}
+
+LoadScope &LoadScope::operator=(LoadScope &&from) {
+	if (this != &from) {
+		for (auto const &lazy : held) {
+			lazy->release();
+		}
+		held = std::move(from.held);
+		from.held.clear();
+	}
+	return *this;
+}
+
+void LoadScope::load() {
+	for (auto const &lazy : held) {
+		lazy->load();
+	}
+}
+
 }
@@ -21,10 +21,81 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. "Meshes"] before looking up individual elements within them.)
  *
+ * Loads can also be split into a CPU phase, which runs on kit::thread_pool() in parallel
+ * with other loads, and a GL phase, which runs on the main thread. The CPU phase returns
+ * the GL phase:
+ *
+ * Load< MeshBuffer > meshes(LoadTagInit, []() {
+ *     auto parsed = MeshBuffer::parse(data_path("meshes.pnct")); //worker thread; no GL calls!
+ *     return [parsed]() -> MeshBuffer const * { return new MeshBuffer(*parsed); }; //main thread
+ * });
+ *
+ * Within a tag, loads may also name other loads they depend on:
+ *
+ * Load< Level > level(LoadTagDefault, []() { ... }, { meshes, textures });
+ *
+ * Every load with a given tag finishes before any load with a later tag starts.
+ * Within a tag, a load starts once its dependencies have finished (both phases).
+ * Loads without a CPU phase run on the main thread, in the order they were added.
+ *
+ * call_load_functions() records the time, CPU time, bytes read, and GPU bytes uploaded
+ * by each load (see load_stats.hpp), labelled with the source location of the Load< >
+ * or a name passed as a LoadLabel:
+ *
+ * Load< MeshBuffer > meshes(LoadTagInit, ..., {}, "meshes");
+ *
+ * If the environment variable KIT_LOAD_REPORT is set, a report is printed after loading
+ * (or, if KIT_LOAD_REPORT ends in ".json", written as JSON to that file).
+ *
+ * Loads tagged LoadTagLazy aren't called by call_load_functions(); instead, they load
+ * the first time they are used (on whatever thread uses them -- so, for loads that make
+ * GL calls, the main thread). prefetch() hints that a lazy load will be needed soon:
+ * (lazy dependencies of a lazy load are loaded first; when prefetching, they are prefetched
+ *  too, and the worker phase starts from the main thread once they have loaded)
+ *
+ * Load< MeshBuffer > credits_meshes(LoadTagLazy, ...);
+ * CreditsMode::CreditsMode() { credits_meshes.prefetch(); } //starts the CPU phase in the background
+ * void CreditsMode::draw() { ... credits_meshes->lookup("Logo") ... } //waits for it, if needed
+ *
+ * Loads tagged LoadTagScoped also load on first use, but are freed (with 'delete', by default)
+ * once no LoadScope holds them. A Mode can hold a LoadScope for the resources it needs;
+ * resources shared by the next Mode stay loaded across set_mode(), since it is made before
+ * the old Mode is destroyed:
+ *
+ * Load< MeshBuffer > level_meshes(LoadTagScoped, ...);
+ * struct LevelMode : kit::Mode {
+ *     kit::LoadScope loads{{ level_meshes, level_textures }}; //starts loading; freed with the Mode
+ *     ...
+ * };
+ *
+ * If the environment variable KIT_HOT_RELOAD is set, call_load_functions() remembers which
+ * files each load opened with data_path() (meshes, animations, textures, shader sources, ...),
+ * and poll_hot_reload() (called by kit's main loop each frame) re-runs the loads that opened
+ * a file when it changes, followed by the loads that list them in their LoadDependencies.
+ * Phased loads run their CPU phase on a worker thread and their GL phase between frames;
+ * single-phase loads -- Load< T >(tag, fn), which may make GL calls -- run entirely on the
+ * main thread, inside poll_hot_reload(), so the frame waits for them.
+ * If reloading fails, the old value is kept (as are the old values of loads that depend on it;
+ * other loads changed at the same time still reload).
+ *
+ * Old values are not freed by default, since loads that don't declare a dependency (e.g.,
+ * a later-tagged 'return &Meshes.get("Main");') may still point into them. A Load< T > can
+ * opt in by setting 'free_on_reload', in which case its old value is freed with 'release'
+ * after a reload caused by a file it opened; only do this if every load that points into
+ * the value lists it in its LoadDependencies (so it is re-run first).
+ * (Hot reload currently needs Linux; LoadTagLazy and LoadTagScoped loads aren't reloaded.)
+ *
  */
 
 #include <functional>
 #include <stdexcept>
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <future>
 #include <cstdint>
 
 namespace kit {
@@ -33,11 +104,139 @@ enum LoadTag : uint32_t {
 	LoadTagInit = 0, //used for loading mesh and texture blobs before default loading phase
 	LoadTagDefault = 1,
 	LoadTagLate = 2,
-	LoadTagCount = 3
+	LoadTagCount = 3,
+	LoadTagLazy = 4, //not called by call_load_functions(); loads on first use instead
+	LoadTagScoped = 5, //like LoadTagLazy, but freed when the last LoadScope holding it is destroyed
 };
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+//LoadLabel names a load in reports; by default, it is the source location where it was constructed:
+struct LoadLabel {
+	LoadLabel(char const *name_ = nullptr, char const *file = __builtin_FILE(), uint32_t line = __builtin_LINE()) {
+		if (name_) {
+			name = name_;
+		} else {
+			std::string path = file;
+			name = path.substr(path.find_last_of("/\\") + 1) + ":" + std::to_string(line);
+		}
+	}
+	std::string name;
+};
+
+struct LoadFunction {
+	std::string label; //for reports
+	//identifies this function for the 'dependencies' of others (a Load< > uses its own address):
+	void const *key = nullptr;
+	//keys of functions (with this tag or earlier ones) that must finish before this one starts:
+	std::vector< void const * > dependencies;
+
+	//either: run on the main thread (after previously-added 'main' functions with the same tag)...
+	std::function< void() > main;
+	//...or: run on a worker thread (no GL calls!), then run the returned function on the main thread:
+	std::function< std::function< void() >() > worker;
+
+	//optional, for hot reload: called on the main thread before the function is run again; returns a function
+	// to call afterward with whether the run succeeded (if not, restore the old value) and whether the old value
+	// may be freed (i.e., the load opened a changed file; Load< T > also requires free_on_reload):
+	std::function< std::function< void(bool succeeded, bool free_old) >() > begin_reload;
+};
+
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadLabel const &label = LoadLabel());
+void add_load_function(LoadTag tag, LoadFunction const &fn);
 void call_load_functions(); //called by main() after GL context created.
+void poll_hot_reload(); //called by kit's main loop each frame; does nothing unless KIT_HOT_RELOAD is set
+
+//what each load function cost:
+struct LoadReport {
+	std::string label;
+	LoadTag tag;
+	double wall_seconds = 0.0; //time spent running (not waiting for dependencies)
+	double cpu_seconds = 0.0; //CPU time used by the threads running it
+	uint64_t bytes_read = 0;
+	uint64_t gpu_bytes = 0;
+	std::vector< std::string > files; //data files opened (via data_path)
+};
+//reports for every load function called so far, in the order they finished:
+std::vector< LoadReport > const &load_reports();
+//print reports as a table, most expensive (wall time) first:
+void print_load_reports(std::ostream &to);
+//write reports as a JSON array:
+void write_load_reports_json(std::ostream &to);
+
+//LazyLoad holds a LoadTagLazy (or LoadTagScoped) function until it is needed:
+struct LazyLoad : std::enable_shared_from_this< LazyLoad > {
+	LazyLoad(LoadTag tag_, LoadFunction const &fn_) : tag(tag_), fn(fn_) { }
+
+	//run the function (if it hasn't been run), on the calling thread:
+	// (if prefetch() started the worker phase, waits for it to finish)
+	void load() {
+		if (!loaded) load_slow();
+	}
+	//start the worker phase on kit::thread_pool() (or, for main-thread-only functions, queue with kit::post_main_thread()):
+	// (if lazy dependencies aren't loaded yet, prefetches them and starts the worker phase once they are)
+	void prefetch();
+
+	//used by LoadScope -- acquire() prefetches; release() of the last scope frees the value (call on the main thread):
+	void acquire();
+	void release();
+
+	//internals:
+	LoadTag tag;
+	LoadFunction fn;
+	std::function< void() > free_value; //frees the loaded value (set for LoadTagScoped loads)
+	std::atomic< bool > loaded{false};
+	std::mutex mutex;
+	uint32_t scopes = 0; //number of LoadScopes holding this load
+	bool prefetching = false;
+	std::shared_future< std::function< void() > > prefetched; //result of the worker phase
+	LoadReport prefetch_report; //(written by the worker before 'prefetched' is ready)
+	void load_slow();
+	void start_worker();
+	std::vector< std::shared_ptr< LazyLoad > > lazy_dependencies() const; //lazy loads named in fn.dependencies
+};
+
+//lets lazy loads find the lazy loads they depend on (by fn.key); called by Load< T >:
+void register_lazy_load(std::shared_ptr< LazyLoad > const &lazy);
+
+template< typename T >
+struct Load;
+
+//LoadDependency names a Load< > that must finish before another Load< > starts (or that a LoadScope holds):
+struct LoadDependency {
+	template< typename T >
+	LoadDependency(Load< T > const &load) : key(&load), lazy(load.lazy) { }
+	void const *key;
+	std::shared_ptr< LazyLoad > lazy;
+};
+typedef std::vector< LoadDependency > LoadDependencies;
+
+inline std::vector< void const * > load_dependency_keys(LoadDependencies const &dependencies) {
+	std::vector< void const * > keys;
+	keys.reserve(dependencies.size());
+	for (auto const &dependency : dependencies) {
+		keys.emplace_back(dependency.key);
+	}
+	return keys;
+}
+
+//LoadScope keeps LoadTagScoped loads loaded while it exists:
+// - construct it after call_load_functions() (e.g., as a member of a Mode); it prefetches each load
+// - loads are reference counted, so a load held by several scopes is freed when the last one is destroyed
+// - destroy it on the main thread (values are freed there, since freeing may make GL calls)
+// - LoadTagLazy loads are loaded but never freed; other loads are always loaded, so listing them does nothing
+struct LoadScope {
+	LoadScope() = default;
+	LoadScope(LoadDependencies const &loads);
+	~LoadScope();
+	LoadScope(LoadScope const &) = delete;
+	LoadScope &operator=(LoadScope const &) = delete;
+	LoadScope(LoadScope &&from) : held(std::move(from.held)) { from.held.clear(); }
+	LoadScope &operator=(LoadScope &&from);
+
+	//finish every load in the scope now (instead of on first use):
+	void load();
+
+	std::vector< std::shared_ptr< LazyLoad > > held;
+};
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
@@ -46,30 +245,106 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
-		add_load_function(tag, [this,load_fn](){
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, LoadDependencies const &dependencies = LoadDependencies(), LoadLabel const &label = LoadLabel()) : value(nullptr) {
+		LoadFunction fn;
+		fn.label = label.name;
+		fn.key = this;
+		fn.dependencies = load_dependency_keys(dependencies);
+		fn.main = [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		};
+		fn.begin_reload = [this]() -> std::function< void(bool, bool) > {
+			T const *old = this->value;
+			return [this,old](bool succeeded, bool free_old) {
+				if (!succeeded) this->value = old;
+				else if (free_old && this->free_on_reload && old && old != this->value && this->release) this->release(old);
+			};
+		};
+		add(tag, fn);
+	}
+
+	//Phased loading: 'cpu_fn' runs on a worker thread and returns a function that makes the value on the main thread:
+	Load(LoadTag tag, const std::function< std::function< T const *() >() > &cpu_fn, LoadDependencies const &dependencies = LoadDependencies(), LoadLabel const &label = LoadLabel()) : value(nullptr) {
+		LoadFunction fn;
+		fn.label = label.name;
+		fn.key = this;
+		fn.dependencies = load_dependency_keys(dependencies);
+		fn.worker = [this,cpu_fn]() -> std::function< void() > {
+			std::function< T const *() > gl_fn = cpu_fn();
+			return [this,gl_fn](){
+				this->value = gl_fn();
+				if (!(this->value)) {
+					throw std::runtime_error("Loading failed.");
+				}
+			};
+		};
+		fn.begin_reload = [this]() -> std::function< void(bool, bool) > {
+			T const *old = this->value;
+			return [this,old](bool succeeded, bool free_old) {
+				if (!succeeded) this->value = old;
+				else if (free_old && this->free_on_reload && old && old != this->value && this->release) this->release(old);
+			};
+		};
+		add(tag, fn);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
+	// (lazy loads load on first use; note that operator bool only checks whether a value is loaded)
 	explicit operator bool() { return value != nullptr; }
-	operator T const *() { return value; }
-	T const &operator*() { return *value; }
-	T const *operator->() { return value; }
+	operator T const *() { return get(); }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
+
+	T const *get() {
+		if (lazy) lazy->load();
+		return value;
+	}
+
+	//hint that a LoadTagLazy load will be used soon (does nothing for other loads):
+	void prefetch() {
+		if (lazy) lazy->prefetch();
+	}
 
 	T const *value;
+	std::shared_ptr< LazyLoad > lazy; //set for LoadTagLazy and LoadTagScoped loads
+
+	//how LoadTagScoped (and hot reloaded) values are freed (replace, e.g., with a function that does nothing for values that point into other loads):
+	std::function< void(T const *) > release = [](T const *v) { delete v; };
+	//free the old value (with 'release') when hot reload replaces it; off by default, since loads that
+	// don't list this one in their LoadDependencies may still point into the old value:
+	bool free_on_reload = false;
+
+private:
+	void add(LoadTag tag, LoadFunction const &fn) {
+		if (tag == LoadTagLazy || tag == LoadTagScoped) {
+			lazy = std::make_shared< LazyLoad >(tag, fn);
+			register_lazy_load(lazy);
+			if (tag == LoadTagScoped) {
+				lazy->free_value = [this](){
+					if (this->release) this->release(this->value);
+					this->value = nullptr;
+				};
+			}
+		} else {
+			add_load_function(tag, fn);
+		}
+	}
 };
 
 //Load< void > just calls a function:
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load( LoadTag tag, const std::function< void() > &load_fn, LoadDependencies const &dependencies = LoadDependencies(), LoadLabel const &label = LoadLabel()) {
+		LoadFunction fn;
+		fn.label = label.name;
+		fn.key = this;
+		fn.dependencies = load_dependency_keys(dependencies);
+		fn.main = load_fn;
+		add_load_function(tag, fn);
 	}
 };
 
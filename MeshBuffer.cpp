@@ -1,145 +1,394 @@
 #include "MeshBuffer.hpp"
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "mesh_optimize.hpp"
+#include "ThreadPool.hpp"
 
 #include "GLBuffer.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <type_traits>
 
 namespace kit {
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	std::ifstream file(filename, std::ios::binary);
+struct MeshBuffer::Parsed {
+	std::unique_ptr< ChunkFile > file; //kept open, since upload may read straight from the mapped file
+	Quantization quantization;
+	std::map< std::string, Mesh > meshes;
+	std::vector< Mesh > mesh_list;
+	std::vector< std::string > mesh_names;
+	std::vector< HashSlot > hash_slots;
+	//creates and fills buffers and sets attrib pointers:
+	std::function< void(MeshBuffer &) > upload;
+};
+
+namespace {
+
+//build open-addressed name hash -> handle table for the given names (handle == index in 'mesh_names'):
+std::vector< MeshBuffer::HashSlot > build_hash_slots(std::vector< std::string > const &mesh_names, std::string const &filename) {
+	typedef MeshBuffer::Handle Handle;
+	Handle const InvalidHandle = MeshBuffer::InvalidHandle;
+	std::vector< MeshBuffer::HashSlot > hash_slots;
+	size_t slots = 16;
+	while (slots < 2 * mesh_names.size()) slots *= 2;
+	hash_slots.assign(slots, MeshBuffer::HashSlot());
+
+	for (Handle handle = 0; handle < mesh_names.size(); ++handle) {
+		uint32_t hash = mesh_name(mesh_names[handle]).hash;
+		size_t slot = hash & (slots - 1);
+		while (hash_slots[slot].used && hash_slots[slot].hash != hash) {
+			slot = (slot + 1) & (slots - 1);
+		}
+		if (hash_slots[slot].used) {
+			if (hash_slots[slot].handle != InvalidHandle) {
+				std::cerr << "WARNING: mesh names '" + mesh_names[hash_slots[slot].handle] + "' and '" + mesh_names[handle] + "' in filename '" + filename + "' have the same hash; look them up by string instead." << std::endl;
+			} else {
+				std::cerr << "WARNING: mesh name '" + mesh_names[handle] + "' in filename '" + filename + "' has the same hash as another mesh; look it up by string instead." << std::endl;
+			}
+			hash_slots[slot].handle = InvalidHandle;
+		} else {
+			hash_slots[slot].used = true;
+			hash_slots[slot].hash = hash;
+			hash_slots[slot].handle = handle;
+		}
+	}
+	return hash_slots;
+}
 
-	auto endswith = [&filename](std::string ext) {
-		return filename.size() >= ext.size() && filename.substr(filename.size()-ext.size()) == ext;
+//read vertex, element, string, and index chunks from a mesh file:
+// fills in parsed->meshes (and friends) and sets parsed->upload to a function that uploads the data to a MeshBuffer
+template< typename Buffer >
+void read_meshes(ChunkFile &file, std::string const &magic, uint32_t flags, MeshBuffer::Parsed *parsed_, std::function< void(MeshBuffer &, Buffer const &) > const &set_attribs) {
+	assert(parsed_);
+	auto &parsed = *parsed_;
+
+	typedef typename Buffer::Vertex Vertex;
+
+	auto data = file.read< Vertex >(magic);
+	GLuint total = data.size(); //store total for later checks on index
+
+	//optional element chunk:
+	ChunkView< uint16_t > elements16;
+	ChunkView< uint32_t > elements32;
+	GLenum index_type = GL_NONE;
+	if (file.peek_magic() == "ix16") {
+		elements16 = file.read< uint16_t >("ix16");
+		index_type = GL_UNSIGNED_SHORT;
+	} else if (file.peek_magic() == "ix32") {
+		elements32 = file.read< uint32_t >("ix32");
+		index_type = GL_UNSIGNED_INT;
+	}
+	size_t element_count = (index_type == GL_UNSIGNED_SHORT ? elements16.size() : elements32.size());
+	auto element = [&](size_t i) -> uint32_t {
+		return (index_type == GL_UNSIGNED_SHORT ? elements16[i] : elements32[i]);
 	};
 
-	GLuint total = 0;
-	//read + upload data chunk:
-	if (endswith(".p") || endswith(".pl")) {
-		GLAttribBuffer< glm::vec3 > buffer_;
-		std::vector< decltype(buffer_)::Vertex > data;
-		read_chunk(file, "p...", &data);
-
-		//upload data:
-		buffer_.set(data, GL_STATIC_DRAW);
-
-		total = data.size(); //store total for later checks on index
-
-		//store attrib locations:
-		Position = buffer_[0];
+	auto strings = file.read< char >("str0");
 
-		this->buffer = std::move(buffer_);
-	} else if (endswith(".pn")) {
-		GLAttribBuffer< glm::vec3, glm::vec3 > buffer_;
-		std::vector< decltype(buffer_)::Vertex > data;
-		read_chunk(file, "pn..", &data);
+	struct Entry {
+		std::string name;
+		uint32_t vertex_begin, vertex_end;
+		uint32_t index_begin, index_end;
+	};
+	std::vector< Entry > entries;
 
-		//upload data:
-		buffer_.set(data, GL_STATIC_DRAW);
+	if (index_type == GL_NONE) { //read index chunk for non-indexed meshes:
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		total = data.size(); //store total for later checks on index
+		auto index = file.read< IndexEntry >("idx0");
+		entries.reserve(index.size());
 
-		//store attrib locations:
-		Position = buffer_[0];
-		Normal = buffer_[1];
+		for (auto const &entry : index) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			entries.emplace_back(Entry{
+				std::string(strings.data() + entry.name_begin, strings.data() + entry.name_end),
+				entry.vertex_begin, entry.vertex_end,
+				0, 0
+			});
+		}
+	} else { //read index chunk for indexed meshes:
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+			uint32_t index_begin, index_end;
+		};
+		static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
 
-		this->buffer = std::move(buffer_);
-	} else if (endswith(".pc")) {
-		GLAttribBuffer< glm::vec3, glm::u8vec4 > buffer_;
-		std::vector< decltype(buffer_)::Vertex > data;
-		read_chunk(file, "pc..", &data);
+		auto index = file.read< IndexEntry >("idx1");
+		entries.reserve(index.size());
 
-		//upload data:
-		buffer_.set(data, GL_STATIC_DRAW);
+		for (auto const &entry : index) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (!(entry.index_begin <= entry.index_end && entry.index_end <= element_count)) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
+			}
+			for (uint32_t i = entry.index_begin; i < entry.index_end; ++i) {
+				uint32_t e = element(i);
+				if (!(entry.vertex_begin <= e && e < entry.vertex_end)) {
+					throw std::runtime_error("mesh has element outside of its vertex range");
+				}
+			}
+			entries.emplace_back(Entry{
+				std::string(strings.data() + entry.name_begin, strings.data() + entry.name_end),
+				entry.vertex_begin, entry.vertex_end,
+				entry.index_begin, entry.index_end
+			});
+		}
+	}
 
-		total = data.size(); //store total for later checks on index
+	//data for the GL phase (views point into the mapped file, which 'parsed' keeps open):
+	struct Upload {
+		ChunkView< Vertex > data;
+		ChunkView< uint16_t > elements16_view;
+		ChunkView< uint32_t > elements32_view;
+		std::vector< uint8_t > vertices;
+		std::vector< uint16_t > elements16;
+		std::vector< uint32_t > elements32;
+
+		Vertex const *vertex_data = nullptr;
+		GLsizei vertex_count = 0;
+		void const *element_data = nullptr;
+		size_t element_bytes = 0;
+	};
+	auto upload = std::make_shared< Upload >();
+
+	if (flags & (MeshBuffer::Weld | MeshBuffer::Optimize)) {
+		//vertices and elements are edited on the CPU before upload:
+		std::vector< uint8_t > vertices;
+		std::vector< uint32_t > elements;
+		if (index_type == GL_NONE) {
+			//weld each mesh separately, so meshes keep contiguous vertex ranges:
+			vertices.reserve(data.size() * sizeof(Vertex));
+			elements.reserve(data.size());
+			for (auto &entry : entries) {
+				uint32_t vertex_begin = uint32_t(vertices.size() / sizeof(Vertex));
+				uint32_t index_begin = uint32_t(elements.size());
+				weld_vertices(data.data(), sizeof(Vertex), entry.vertex_begin, entry.vertex_end, &vertices, &elements);
+				entry.vertex_begin = vertex_begin;
+				entry.vertex_end = uint32_t(vertices.size() / sizeof(Vertex));
+				entry.index_begin = index_begin;
+				entry.index_end = uint32_t(elements.size());
+			}
+		} else {
+			vertices.assign(reinterpret_cast< uint8_t const * >(data.data()), reinterpret_cast< uint8_t const * >(data.data() + data.size()));
+			elements.reserve(element_count);
+			for (size_t i = 0; i < element_count; ++i) {
+				elements.emplace_back(element(i));
+			}
+		}
 
-		//store attrib locations:
-		Position = buffer_[0];
-		Color = buffer_[1];
+		if (flags & MeshBuffer::Optimize) {
+			//vertex reordering is only safe if no two meshes share vertices:
+			bool disjoint = true;
+			{
+				std::vector< std::pair< uint32_t, uint32_t > > ranges;
+				for (auto const &entry : entries) {
+					if (entry.vertex_begin < entry.vertex_end) ranges.emplace_back(entry.vertex_begin, entry.vertex_end);
+				}
+				std::sort(ranges.begin(), ranges.end());
+				for (size_t i = 1; i < ranges.size(); ++i) {
+					if (ranges[i].first < ranges[i-1].second) disjoint = false;
+				}
+			}
+			if (!disjoint) {
+				std::cerr << "WARNING: meshes in '" + file.filename + "' share vertices; not optimizing vertex order." << std::endl;
+			}
 
-		this->buffer = std::move(buffer_);
-	} else if (endswith(".pnc")) {
-		GLAttribBuffer< glm::vec3, glm::vec3, glm::u8vec4 > buffer_;
-		std::vector< decltype(buffer_)::Vertex > data;
-		read_chunk(file, "pnc.", &data);
+			for (auto const &entry : entries) {
+				//optimize with mesh-relative indices:
+				uint32_t *begin = elements.data() + entry.index_begin;
+				size_t count = entry.index_end - entry.index_begin;
+				uint32_t vertex_count = entry.vertex_end - entry.vertex_begin;
+				if (count % 3 != 0) {
+					std::cerr << "WARNING: mesh in '" + file.filename + "' has an index count that isn't a multiple of three; not optimizing." << std::endl;
+					continue;
+				}
+				uint8_t *mesh_vertices = vertices.data() + size_t(entry.vertex_begin) * sizeof(Vertex);
+				for (size_t i = 0; i < count; ++i) begin[i] -= entry.vertex_begin;
+				optimize_vertex_cache(begin, count, vertex_count);
+				//(positions are always the first attribute; quantized positions are skipped, since they were optimized before quantizing)
+				if (std::is_same< decltype(Vertex::a0), glm::vec3 >::value) {
+					optimize_overdraw(begin, count, mesh_vertices, sizeof(Vertex), vertex_count);
+				}
+				if (disjoint) optimize_vertex_fetch(begin, count, mesh_vertices, sizeof(Vertex), vertex_count);
+				for (size_t i = 0; i < count; ++i) begin[i] += entry.vertex_begin;
+			}
+		}
 
-		//upload data:
-		buffer_.set(data, GL_STATIC_DRAW);
+		upload->vertices = std::move(vertices);
+		upload->vertex_data = reinterpret_cast< Vertex const * >(upload->vertices.data());
+		upload->vertex_count = GLsizei(upload->vertices.size() / sizeof(Vertex));
+		if (upload->vertex_count <= 0x10000) {
+			upload->elements16.assign(elements.begin(), elements.end());
+			upload->element_data = upload->elements16.data();
+			upload->element_bytes = upload->elements16.size() * sizeof(uint16_t);
+			index_type = GL_UNSIGNED_SHORT;
+		} else {
+			upload->elements32 = std::move(elements);
+			upload->element_data = upload->elements32.data();
+			upload->element_bytes = upload->elements32.size() * sizeof(uint32_t);
+			index_type = GL_UNSIGNED_INT;
+		}
+	} else {
+		//upload data straight from the mapped file:
+		upload->data = std::move(data);
+		upload->vertex_data = upload->data.data();
+		upload->vertex_count = GLsizei(upload->data.size());
+		if (index_type == GL_UNSIGNED_SHORT) {
+			upload->elements16_view = std::move(elements16);
+			upload->element_data = upload->elements16_view.data();
+			upload->element_bytes = upload->elements16_view.size() * sizeof(uint16_t);
+		} else if (index_type == GL_UNSIGNED_INT) {
+			upload->elements32_view = std::move(elements32);
+			upload->element_data = upload->elements32_view.data();
+			upload->element_bytes = upload->elements32_view.size() * sizeof(uint32_t);
+		}
+	}
 
-		total = data.size(); //store total for later checks on index
+	bool indexed = (index_type != GL_NONE);
+	parsed.upload = [upload,indexed,set_attribs](MeshBuffer &mesh_buffer) {
+		Buffer buffer;
+		buffer.set(upload->vertex_count, upload->vertex_data, GL_STATIC_DRAW);
+		//NOTE: element data is uploaded via GL_ARRAY_BUFFER so as not to disturb the bound vertex array:
+		if (indexed) {
+			mesh_buffer.indices.set(GL_ARRAY_BUFFER, upload->element_bytes, upload->element_data, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		//store attrib locations:
-		Position = buffer_[0];
-		Normal = buffer_[1];
-		Color = buffer_[2];
+		set_attribs(mesh_buffer, buffer);
+		mesh_buffer.buffer = std::move(buffer);
+	};
 
-		this->buffer = std::move(buffer_);
-	} else if (endswith(".pnct")) {
-		GLAttribBuffer< glm::vec3, glm::vec3, glm::u8vec4, glm::vec2 > buffer_;
-		std::vector< decltype(buffer_)::Vertex > data;
-		read_chunk(file, "pnct", &data);
+	for (auto const &entry : entries) {
+		MeshBuffer::Mesh mesh;
+		mesh.type = GL_TRIANGLES;
+		mesh.start = entry.vertex_begin;
+		mesh.count = entry.vertex_end - entry.vertex_begin;
+		if (index_type != GL_NONE) {
+			mesh.index_type = index_type;
+			mesh.index_start = entry.index_begin;
+			mesh.index_count = entry.index_end - entry.index_begin;
+		}
+		bool inserted = parsed.meshes.insert(std::make_pair(entry.name, mesh)).second;
+		if (!inserted) {
+			std::cerr << "WARNING: mesh name '" + entry.name + "' in filename '" + file.filename + "' collides with existing mesh." << std::endl;
+		} else {
+			parsed.mesh_list.emplace_back(mesh);
+			parsed.mesh_names.emplace_back(entry.name);
+		}
+	}
+	parsed.hash_slots = build_hash_slots(parsed.mesh_names, file.filename);
+}
 
-		//upload data:
-		buffer_.set(data, GL_STATIC_DRAW);
+} //namespace
 
-		total = data.size(); //store total for later checks on index
+std::shared_ptr< MeshBuffer::Parsed > MeshBuffer::parse(std::string const &filename, uint32_t flags) {
+	auto parsed = std::make_shared< Parsed >();
+	parsed->file.reset(new ChunkFile(filename));
+	ChunkFile &file = *parsed->file;
 
-		//store attrib locations:
-		Position = buffer_[0];
-		Normal = buffer_[1];
-		Color = buffer_[2];
-		TexCoord = buffer_[3];
+	auto endswith = [&filename](std::string ext) {
+		return filename.size() >= ext.size() && filename.substr(filename.size()-ext.size()) == ext;
+	};
 
-		this->buffer = std::move(buffer_);
+	//read data:
+	if (endswith(".p") || endswith(".pl")) {
+		typedef GLAttribBuffer< glm::vec3 > Buffer;
+		read_meshes< Buffer >(file, "p...", flags, parsed.get(), [](MeshBuffer &mesh_buffer, Buffer const &buffer) {
+			//store attrib locations:
+			mesh_buffer.Position = buffer[0];
+		});
+	} else if (endswith(".pn")) {
+		typedef GLAttribBuffer< glm::vec3, glm::vec3 > Buffer;
+		read_meshes< Buffer >(file, "pn..", flags, parsed.get(), [](MeshBuffer &mesh_buffer, Buffer const &buffer) {
+			//store attrib locations:
+			mesh_buffer.Position = buffer[0];
+			mesh_buffer.Normal = buffer[1];
+		});
+	} else if (endswith(".pc")) {
+		typedef GLAttribBuffer< glm::vec3, glm::u8vec4 > Buffer;
+		read_meshes< Buffer >(file, "pc..", flags, parsed.get(), [](MeshBuffer &mesh_buffer, Buffer const &buffer) {
+			//store attrib locations:
+			mesh_buffer.Position = buffer[0];
+			mesh_buffer.Color = buffer[1];
+		});
+	} else if (endswith(".pnc")) {
+		typedef GLAttribBuffer< glm::vec3, glm::vec3, glm::u8vec4 > Buffer;
+		read_meshes< Buffer >(file, "pnc.", flags, parsed.get(), [](MeshBuffer &mesh_buffer, Buffer const &buffer) {
+			//store attrib locations:
+			mesh_buffer.Position = buffer[0];
+			mesh_buffer.Normal = buffer[1];
+			mesh_buffer.Color = buffer[2];
+		});
+	} else if (endswith(".pnct")) {
+		typedef GLAttribBuffer< glm::vec3, glm::vec3, glm::u8vec4, glm::vec2 > Buffer;
+		read_meshes< Buffer >(file, "pnct", flags, parsed.get(), [](MeshBuffer &mesh_buffer, Buffer const &buffer) {
+			//store attrib locations:
+			mesh_buffer.Position = buffer[0];
+			mesh_buffer.Normal = buffer[1];
+			mesh_buffer.Color = buffer[2];
+			mesh_buffer.TexCoord = buffer[3];
+		});
+	} else if (endswith(".pnctq")) {
+		typedef GLAttribBuffer< GLHalf4, GLSNorm3x10_1x2, glm::u8vec4, glm::u16vec2 > Buffer;
+		static_assert(sizeof(Buffer::Vertex) == 20, "quantized vertex is packed");
+		file.read_struct("qnt0", &parsed->quantization);
+		read_meshes< Buffer >(file, "pnq.", flags, parsed.get(), [](MeshBuffer &mesh_buffer, Buffer const &buffer) {
+			//store attrib locations:
+			mesh_buffer.Position = buffer[0];
+			mesh_buffer.Normal = buffer[1];
+			mesh_buffer.Color = buffer[2];
+			mesh_buffer.TexCoord = buffer[3];
+		});
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
-	assert(this->buffer.buffer);
-
+	assert(parsed->upload);
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	if (!file.at_end()) {
+		std::cerr << "WARNING: trailing data in mesh file '" + filename + "'" << std::endl;
+	}
 
-	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	return parsed;
+}
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+MeshBuffer::MeshBuffer(Parsed &parsed) {
+	//upload data:
+	parsed.upload(*this);
+	assert(this->buffer.buffer);
 
-		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-				throw std::runtime_error("index entry has out-of-range name begin/end");
-			}
-			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
-				throw std::runtime_error("index entry has out-of-range vertex start/count");
-			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-			Mesh mesh;
-			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
-			}
-		}
-	}
+	quantization = parsed.quantization;
+	meshes = std::move(parsed.meshes);
+	mesh_list = std::move(parsed.mesh_list);
+	mesh_names = std::move(parsed.mesh_names);
+	hash_slots = std::move(parsed.hash_slots);
+}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" + filename + "'" << std::endl;
-	}
+MeshBuffer::MeshBuffer(std::string const &filename, uint32_t flags) : MeshBuffer(*parse(filename, flags)) {
 }
 
 const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const {
@@ -150,4 +399,87 @@ const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const {
 	return f->second;
 }
 
+const MeshBuffer::Mesh &MeshBuffer::lookup(MeshName name) const {
+	Handle handle = find(name);
+	if (handle == InvalidHandle) {
+		throw std::runtime_error("Looking up mesh by hash " + std::to_string(name.hash) + " that doesn't exist (or whose name collides with another mesh's).");
+	}
+	return mesh_list[handle];
+}
+
+MeshBuffer::Handle MeshBuffer::find(MeshName name) const {
+	if (hash_slots.empty()) return InvalidHandle;
+	size_t mask = hash_slots.size() - 1;
+	for (size_t slot = name.hash & mask; hash_slots[slot].used; slot = (slot + 1) & mask) {
+		if (hash_slots[slot].hash == name.hash) return hash_slots[slot].handle;
+	}
+	return InvalidHandle;
+}
+
+MeshBuffer::Handle MeshBuffer::find(std::string const &name) const {
+	Handle handle = find(mesh_name(name));
+	if (handle != InvalidHandle && mesh_names[handle] == name) return handle;
+	//hash collision (or missing name), so search names:
+	for (Handle h = 0; h < mesh_names.size(); ++h) {
+		if (mesh_names[h] == name) return h;
+	}
+	return InvalidHandle;
+}
+
+void MeshBuffer::draw(Mesh const &mesh) const {
+	if (mesh.index_type == GL_NONE) {
+		glDrawArrays(mesh.type, mesh.start, mesh.count);
+	} else {
+		if (mesh.index_count == 0) return;
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.buffer);
+		size_t index_size = (mesh.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+		glDrawRangeElements(mesh.type, mesh.start, mesh.start + mesh.count - 1, mesh.index_count, mesh.index_type, (GLbyte *)0 + mesh.index_start * index_size);
+	}
+}
+
+//------------------------------------------------
+
+struct AsyncMeshBuffer::State {
+	std::atomic< bool > ready{false};
+	std::unique_ptr< MeshBuffer > mesh_buffer;
+	std::exception_ptr error;
+};
+
+AsyncMeshBuffer::AsyncMeshBuffer(std::string const &filename, uint32_t flags) : state(std::make_shared< State >()) {
+	std::shared_ptr< State > state = this->state;
+	thread_pool().run([state,filename,flags]() mutable {
+		std::shared_ptr< MeshBuffer::Parsed > parsed;
+		try {
+			parsed = MeshBuffer::parse(filename, flags);
+		} catch (...) {
+			state->error = std::current_exception();
+			state->ready = true;
+			return;
+		}
+		//(hand 'state' over to the main thread task, so the last reference -- and, with it, any GL objects -- never drops here)
+		post_main_thread([state = std::move(state),parsed](){
+			try {
+				state->mesh_buffer.reset(new MeshBuffer(*parsed));
+			} catch (...) {
+				state->error = std::current_exception();
+			}
+			state->ready = true;
+		});
+	});
+}
+
+bool AsyncMeshBuffer::ready() const {
+	return state->ready;
+}
+
+MeshBuffer const &AsyncMeshBuffer::get() const {
+	if (!state->ready) {
+		throw std::runtime_error("Using AsyncMeshBuffer before it is ready.");
+	}
+	if (state->error) {
+		std::rethrow_exception(state->error);
+	}
+	return *state->mesh_buffer;
+}
+
 }
@@ -3,13 +3,45 @@
 #include "GLBuffer.hpp"
 
 #include <string>
+#include <vector>
 #include <map>
+#include <memory>
 
 //"MeshBuffer" holds a collection of meshes loaded from a file
 // (note that meshes in a single collection will share a buffer)
+//
+//Mesh files hold a vertex chunk, an optional element chunk, a string chunk, and an index chunk:
+// vertex chunk: "p...", "pn..", "pc..", "pnc.", "pnct", or "pnq." depending on file extension
+// "qnt0" (".pnctq" only, before the vertex chunk): a MeshBuffer::Quantization struct
+// element chunk (optional): "ix16" (uint16_t indices) or "ix32" (uint32_t indices)
+// "str0": mesh names
+// "idx0" (no element chunk): name begin/end, vertex begin/end for each mesh
+// "idx1" (with element chunk): name begin/end, vertex begin/end, index begin/end for each mesh
 
 namespace kit {
 
+//Mesh names are hashed (32-bit FNV-1a) for handle lookups:
+struct MeshName {
+	uint32_t hash;
+};
+constexpr MeshName mesh_name(char const *name, size_t length) {
+	uint32_t hash = 0x811c9dc5U;
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ uint8_t(name[i])) * 0x01000193U;
+	}
+	return MeshName{ hash };
+}
+inline MeshName mesh_name(std::string const &name) {
+	return mesh_name(name.data(), name.size());
+}
+
+//compile-time mesh names -- e.g., 'buffer->find("Cube"_mesh)' -- with 'using namespace kit::literals;':
+inline namespace literals {
+	constexpr MeshName operator""_mesh(char const *name, size_t length) {
+		return mesh_name(name, length);
+	}
+}
+
 struct MeshBuffer {
 	GLAttribPointer Position;
 	GLAttribPointer Normal;
@@ -17,22 +49,114 @@ struct MeshBuffer {
 	GLAttribPointer TexCoord;
 
 	GLBuffer buffer;
+	GLBuffer indices; //element data, for indexed meshes
+
+	//".pnctq" files store compact (20-byte) vertices:
+	// half-float position (w unused), GL_INT_2_10_10_10_REV normal, u8 color, unorm16 texcoord
+	//positions and texcoords must be expanded (e.g., in the vertex shader) using:
+	// position = stored.xyz * position_scale + position_offset
+	// texcoord = stored * texcoord_scale + texcoord_offset
+	//(for other formats, quantization is the identity)
+	struct Quantization {
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		glm::vec3 position_offset = glm::vec3(0.0f);
+		glm::vec2 texcoord_scale = glm::vec2(1.0f);
+		glm::vec2 texcoord_offset = glm::vec2(0.0f);
+	};
+	static_assert(sizeof(Quantization) == 40, "Quantization is packed");
+	Quantization quantization;
+
+	enum Flags : uint32_t {
+		//merge identical vertices of non-indexed meshes at load time, making them indexed:
+		Weld = (1 << 0),
+		//reorder triangles and vertices for the post-transform cache, overdraw, and vertex fetch at load time
+		// (implies Weld; see mesh_optimize.hpp -- export/optimize-meshes.cpp does the same thing offline):
+		Optimize = (1 << 1),
+	};
 
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	MeshBuffer(std::string const &filename, uint32_t flags = 0);
+
+	//loading happens in two phases, which may be run separately (see AsyncMeshBuffer, below):
+	//parse reads, validates, and (per 'flags') welds/optimizes data; it makes no GL calls, so is safe on any thread:
+	// note: will throw if file fails to read.
+	struct Parsed;
+	static std::shared_ptr< Parsed > parse(std::string const &filename, uint32_t flags = 0);
+	//construct from parsed data by creating and uploading buffers (GL thread only):
+	MeshBuffer(Parsed &parsed);
 
 	//look up a particular mesh in the DB:
 	// note: will throw if mesh not found.
 	struct Mesh {
 		GLuint type = GL_TRIANGLES;
-		GLuint start = 0;
-		GLuint count = 0;
+		GLuint start = 0; //first vertex (for indexed meshes: first vertex referenced by indices)
+		GLuint count = 0; //vertex count (for indexed meshes: number of vertices referenced by indices)
+
+		//indexed meshes have index_type of GL_UNSIGNED_SHORT or GL_UNSIGNED_INT:
+		GLenum index_type = GL_NONE;
+		GLuint index_start = 0; //first index (in indices, not bytes)
+		GLuint index_count = 0;
 	};
 	const Mesh &lookup(std::string const &name) const;
+	const Mesh &lookup(MeshName name) const; //(same caveat as find(MeshName), below)
+
+	//handles are indices into mesh_list, and stay valid for the life of the MeshBuffer:
+	// (look up a handle once, then use operator[] in draw paths)
+	typedef uint32_t Handle;
+	static constexpr Handle InvalidHandle = -1U;
+	//compares hashes only, so:
+	// returns InvalidHandle if no mesh has this hash (or if two meshes' names hash to it);
+	// a name that isn't in the buffer but shares a hash with one that is returns that other mesh
+	// (use find(std::string) when the name may be missing):
+	Handle find(MeshName name) const;
+	//returns InvalidHandle if mesh not found:
+	Handle find(std::string const &name) const;
+	Mesh const &operator[](Handle handle) const {
+		assert(handle < mesh_list.size());
+		return mesh_list[handle];
+	}
+
+	//draw a mesh, using whatever vertex array is currently bound:
+	// (binds 'indices' as the vertex array's element buffer if the mesh is indexed)
+	void draw(Mesh const &mesh) const;
 
 	//internals:
-	std::map< std::string, Mesh > meshes;
+	std::map< std::string, Mesh > meshes; //slow path for string lookups
+	std::vector< Mesh > mesh_list; //in file order; indexed by Handle
+	std::vector< std::string > mesh_names; //parallel to mesh_list
+	//open-addressed name hash -> handle table (power-of-two size, at most half full):
+	struct HashSlot {
+		uint32_t hash = 0;
+		Handle handle = InvalidHandle; //InvalidHandle in a used slot marks a hash collision
+		bool used = false;
+	};
+	std::vector< HashSlot > hash_slots;
+};
+
+//"AsyncMeshBuffer" loads a MeshBuffer without blocking the GL thread:
+// the file is parsed on kit::thread_pool(), then buffers are uploaded from a kit::post_main_thread() task.
+//
+//  AsyncMeshBuffer level_meshes("level.pnct");
+//  //...later, each frame:
+//  if (level_meshes.ready()) draw(level_meshes->lookup("Floor"));
+struct AsyncMeshBuffer {
+	AsyncMeshBuffer(std::string const &filename, uint32_t flags = 0);
+	AsyncMeshBuffer(AsyncMeshBuffer const &) = delete;
+	AsyncMeshBuffer &operator=(AsyncMeshBuffer const &) = delete;
+
+	//true once the mesh buffer is uploaded (or loading failed):
+	bool ready() const;
+
+	//get the loaded mesh buffer:
+	// note: will throw if not ready, and rethrows the error if loading failed.
+	MeshBuffer const &get() const;
+	MeshBuffer const *operator->() const { return &get(); }
+	MeshBuffer const &operator*() const { return get(); }
+
+	//internals (shared with the loading tasks, which may outlive this object):
+	struct State;
+	std::shared_ptr< State > state;
 };
 
 }
@@ -0,0 +1,169 @@
+#include "ThreadPool.hpp"
+
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace kit {
+
+ThreadPool::ThreadPool(uint32_t threads) {
+	if (threads == 0) {
+		threads = std::max(1U, std::thread::hardware_concurrency()) - 1;
+		threads = std::max(1U, threads);
+	}
+	workers.reserve(threads);
+	for (uint32_t i = 0; i < threads; ++i) {
+		workers.emplace_back(&ThreadPool::worker_main, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(std::function< void() > const &job) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		assert(!quit);
+		jobs.emplace_back(job);
+	}
+	cv.notify_one();
+}
+
+void ThreadPool::worker_main() {
+	while (true) {
+		std::function< void() > job;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			cv.wait(lock, [this](){ return quit || !jobs.empty(); });
+			if (jobs.empty()) return; //(quit is set and no work is left)
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		try {
+			job();
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: job on thread pool threw exception: " << e.what() << std::endl;
+		}
+	}
+}
+
+void ThreadPool::parallel_for(size_t count, std::function< void(size_t) > const &fn) {
+	if (count == 0) return;
+	if (count == 1) {
+		fn(0);
+		return;
+	}
+
+	//shared between the calling thread and helper jobs; helpers may outlive this call
+	// (if they are dequeued after all the work is done), so it is reference counted:
+	struct State {
+		std::function< void(size_t) > fn;
+		size_t count = 0;
+		std::atomic< size_t > next{0};
+		std::mutex mutex;
+		std::condition_variable cv;
+		size_t finished = 0;
+		std::exception_ptr exception;
+	};
+	auto state = std::make_shared< State >();
+	state->fn = fn;
+	state->count = count;
+
+	auto work = [](State &state) {
+		size_t done = 0;
+		std::exception_ptr exception;
+		while (true) {
+			size_t i = state.next.fetch_add(1);
+			if (i >= state.count) break;
+			if (!exception) {
+				try {
+					state.fn(i);
+				} catch (...) {
+					exception = std::current_exception();
+				}
+			}
+			++done;
+		}
+		if (done == 0) return;
+		std::unique_lock< std::mutex > lock(state.mutex);
+		if (exception && !state.exception) state.exception = exception;
+		state.finished += done;
+		if (state.finished == state.count) state.cv.notify_all();
+	};
+
+	size_t helpers = std::min< size_t >(workers.size(), count - 1);
+	for (size_t h = 0; h < helpers; ++h) {
+		run([state,work](){ work(*state); });
+	}
+
+	work(*state);
+
+	std::unique_lock< std::mutex > lock(state->mutex);
+	state->cv.wait(lock, [&state](){ return state->finished == state->count; });
+	if (state->exception) {
+		std::rethrow_exception(state->exception);
+	}
+}
+
+ThreadPool &thread_pool() {
+	static ThreadPool pool;
+	return pool;
+}
+
+namespace {
+	struct MainThreadTasks {
+		std::mutex mutex;
+		std::deque< std::function< void() > > tasks;
+	};
+	MainThreadTasks &main_thread_tasks() {
+		static MainThreadTasks main_thread;
+		return main_thread;
+	}
+}
+
+void post_main_thread(std::function< void() > task) {
+	auto &main_thread = main_thread_tasks();
+	std::unique_lock< std::mutex > lock(main_thread.mutex);
+	main_thread.tasks.emplace_back(std::move(task));
+}
+
+size_t run_main_thread_tasks(float budget) {
+	auto &main_thread = main_thread_tasks();
+	auto start = std::chrono::steady_clock::now();
+	while (true) {
+		std::function< void() > task;
+		{
+			std::unique_lock< std::mutex > lock(main_thread.mutex);
+			if (main_thread.tasks.empty()) return 0;
+			task = std::move(main_thread.tasks.front());
+			main_thread.tasks.pop_front();
+		}
+		//(run without the lock held, so tasks can post more tasks)
+		try {
+			task();
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: main thread task threw exception: " << e.what() << std::endl;
+		}
+		task = nullptr; //(release captures before checking the time)
+
+		//(checked after running, so at least one task runs even with a budget of zero)
+		if (std::chrono::duration< float >(std::chrono::steady_clock::now() - start).count() >= budget) {
+			std::unique_lock< std::mutex > lock(main_thread.mutex);
+			return main_thread.tasks.size();
+		}
+	}
+}
+
+}
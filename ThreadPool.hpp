@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+ * ThreadPool runs jobs on a fixed set of worker threads.
+ *
+ * Most code will want the shared pool:
+ *
+ *   kit::thread_pool().run([](){ ...some work... });
+ *
+ *   kit::thread_pool().parallel_for(blocks.size(), [&](size_t i) {
+ *       decode(blocks[i]);
+ *   });
+ *
+ * parallel_for also does work on the calling thread, so it is safe to call
+ *  from inside a job that is itself running on the pool.
+ *
+ * Work that must happen on the main thread (e.g., GL calls) can be handed back
+ *  from a job with post_main_thread(); kit's main loop runs these tasks each frame:
+ *
+ *   kit::thread_pool().run([](){
+ *       auto data = parse(...);
+ *       kit::post_main_thread([data](){ upload(data); });
+ *   });
+ *
+ */
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace kit {
+
+struct ThreadPool {
+	//threads == 0 means "one fewer than the number of hardware threads" (but at least one):
+	ThreadPool(uint32_t threads = 0);
+	~ThreadPool(); //finishes queued jobs before returning
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//queue a job to run on some worker thread:
+	// (exceptions thrown by the job are reported and otherwise ignored)
+	void run(std::function< void() > const &job);
+
+	//call fn(i) for every i in [0,count), spread over the workers and the calling thread:
+	// returns when all calls are finished; rethrows the first exception thrown by fn.
+	void parallel_for(size_t count, std::function< void(size_t) > const &fn);
+
+	uint32_t size() const { return uint32_t(workers.size()); }
+
+	//internals:
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque< std::function< void() > > jobs;
+	bool quit = false;
+	void worker_main();
+};
+
+//shared pool, created on first use:
+ThreadPool &thread_pool();
+
+//queue a task to run on the main thread (safe to call from any thread):
+// (the task is moved into the queue, so whatever it captures is released on the main thread)
+void post_main_thread(std::function< void() > task);
+//run queued main-thread tasks, in the order they were posted; called by kit's main loop once per frame:
+// stops starting new tasks once 'budget' seconds have passed (but always runs at least one);
+// returns the number of tasks still queued. Exceptions thrown by tasks are reported and otherwise ignored.
+size_t run_main_thread_tasks(float budget = std::numeric_limits< float >::infinity());
+
+}
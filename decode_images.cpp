@@ -0,0 +1,153 @@
+#include "decode_images.hpp"
+#include "load_hdr.hpp"
+#include "load_stats.hpp"
+#include "ThreadPool.hpp"
+
+#ifdef KIT_USE_JPEG
+#include "load_save_jpeg.hpp"
+#endif
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cctype>
+
+namespace kit {
+
+namespace {
+	DecodedImage decode_image(std::string const &path, OriginLocation origin) {
+		std::string extension;
+		{
+			auto dot = path.rfind('.');
+			if (dot != std::string::npos) extension = path.substr(dot + 1);
+			for (auto &c : extension) c = char(std::tolower(c));
+		}
+
+		DecodedImage image;
+		try {
+			if (extension == "jpg" || extension == "jpeg") {
+				#ifdef KIT_USE_JPEG
+				image.loaded = load_jpeg(path, &image.size.x, &image.size.y, &image.data, origin);
+				#else
+				std::cerr << "WARNING: can't decode '" << path << "' because kit was built without KIT_USE_JPEG." << std::endl;
+				return image;
+				#endif
+			} else if (extension == "hdr") {
+				image.loaded = load_hdr(path, &image.size.x, &image.size.y, &image.data, origin);
+			} else {
+				image.loaded = load_png(path, &image.size.x, &image.size.y, &image.data, origin);
+			}
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: exception decoding '" << path << "': " << e.what() << std::endl;
+			image.loaded = false;
+		}
+		if (!image.loaded) {
+			std::cerr << "WARNING: failed to decode '" << path << "'." << std::endl;
+			image.size = glm::uvec2(0);
+			image.data.clear();
+		}
+		return image;
+	}
+
+	//shared by the calling thread and the pool jobs helping it (which may outlive the call):
+	struct Batch {
+		std::vector< std::string > paths;
+		OriginLocation origin;
+		size_t window;
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		size_t started = 0; //images [0,started) are being (or have been) decoded
+		size_t delivered = 0; //images [0,delivered) have been handed to the callback
+		uint32_t helpers = 0; //pool jobs currently running help()
+		std::vector< DecodedImage > images;
+		std::vector< bool > done;
+		std::vector< uint64_t > bytes_read; //bytes read by pool threads, to count on the calling thread
+
+		//pick the next image to decode, if there is room in the window:
+		bool claim(size_t *index) {
+			if (started < paths.size() && started < delivered + window) {
+				*index = started++;
+				return true;
+			}
+			return false;
+		}
+
+		//decode image 'index' with the mutex released:
+		void decode(size_t index, std::unique_lock< std::mutex > &lock, bool on_pool) {
+			lock.unlock();
+			uint64_t before = load_counters().bytes_read;
+			DecodedImage image = decode_image(paths[index], origin);
+			uint64_t bytes = load_counters().bytes_read - before;
+			lock.lock();
+			images[index] = std::move(image);
+			done[index] = true;
+			if (on_pool) bytes_read[index] = bytes;
+			cv.notify_all();
+		}
+	};
+
+	void help(std::shared_ptr< Batch > const &batch) {
+		std::unique_lock< std::mutex > lock(batch->mutex);
+		size_t index;
+		while (batch->claim(&index)) {
+			batch->decode(index, lock, true);
+		}
+		batch->helpers -= 1;
+	}
+}
+
+void decode_images(std::vector< std::string > const &paths, OriginLocation origin, std::function< void(size_t index, DecodedImage &&image) > const &on_decoded, uint32_t max_in_flight) {
+	ThreadPool &pool = thread_pool();
+
+	auto batch = std::make_shared< Batch >();
+	batch->paths = paths;
+	batch->origin = origin;
+	batch->window = (max_in_flight ? max_in_flight : pool.size() + 1);
+	batch->images.resize(paths.size());
+	batch->done.resize(paths.size(), false);
+	batch->bytes_read.resize(paths.size(), 0);
+
+	std::unique_lock< std::mutex > lock(batch->mutex);
+	while (batch->delivered < paths.size()) {
+		//keep the pool busy with whatever fits in the window:
+		size_t waiting = std::min(paths.size(), batch->delivered + batch->window) - batch->started;
+		while (batch->helpers < pool.size() && batch->helpers < waiting) {
+			batch->helpers += 1;
+			pool.run([batch](){ help(batch); });
+		}
+
+		size_t next = batch->delivered;
+		if (batch->done[next]) {
+			DecodedImage image = std::move(batch->images[next]);
+			uint64_t bytes = batch->bytes_read[next];
+			lock.unlock();
+			count_bytes_read(bytes);
+			on_decoded(next, std::move(image));
+			lock.lock();
+			batch->delivered += 1; //(only now, so images being handled count against the window)
+			continue;
+		}
+
+		//rather than just waiting, decode something here (this also guarantees progress if the pool is busy):
+		size_t index;
+		if (batch->claim(&index)) {
+			batch->decode(index, lock, false);
+			continue;
+		}
+
+		batch->cv.wait(lock);
+	}
+}
+
+std::vector< DecodedImage > decode_images(std::vector< std::string > const &paths, OriginLocation origin, uint32_t max_in_flight) {
+	std::vector< DecodedImage > images(paths.size());
+	decode_images(paths, origin, [&](size_t index, DecodedImage &&image) {
+		images[index] = std::move(image);
+	}, max_in_flight);
+	return images;
+}
+
+}
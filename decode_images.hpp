@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+ * Decode many image files at once, spread over kit::thread_pool():
+ *
+ *   std::vector< kit::DecodedImage > images = kit::decode_images(paths, LowerLeftOrigin);
+ *
+ * Or, to handle each image as soon as it (and every image before it) is ready,
+ *  without keeping all of them around:
+ *
+ *   kit::decode_images(paths, LowerLeftOrigin, [&](size_t index, kit::DecodedImage &&image) {
+ *       ...use image; called on the calling thread, in the order of 'paths'...
+ *   });
+ *
+ * At most 'max_in_flight' images are being decoded or waiting to be handed to the
+ *  callback at once (0 means "one more than the number of pool threads"), which caps
+ *  peak memory when using the callback.
+ *
+ * The format is picked by extension: .png (load_png), .jpg / .jpeg (load_jpeg, when
+ *  built with KIT_USE_JPEG), and .hdr (load_hdr).
+ * Bytes read by the pool threads are counted (see load_stats.hpp) on the calling thread.
+ */
+
+#include "load_save_png.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace kit {
+
+struct DecodedImage {
+	bool loaded = false; //false if the image couldn't be read or decoded (a warning is printed)
+	glm::uvec2 size = glm::uvec2(0);
+	std::vector< uint32_t > data; //as returned by load_png et al.
+};
+
+std::vector< DecodedImage > decode_images(std::vector< std::string > const &paths, OriginLocation origin, uint32_t max_in_flight = 0);
+
+void decode_images(std::vector< std::string > const &paths, OriginLocation origin, std::function< void(size_t index, DecodedImage &&image) > const &on_decoded, uint32_t max_in_flight = 0);
+
+}
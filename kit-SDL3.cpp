@@ -6,6 +6,8 @@
 #endif
 
 #include "Button.hpp"
+#include "ThreadPool.hpp"
+#include "Load.hpp"
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
@@ -266,6 +268,10 @@ int main(int argc, char **argv) {
 			//TODO: wait if updating too quickly.
 			then = now;
 		}
+		//re-run loads whose files changed (if KIT_HOT_RELOAD is set):
+		kit::poll_hot_reload();
+		//finish work handed back by background loads:
+		kit::run_main_thread_tasks(kit_config.main_thread_task_budget);
 		if (mode) {
 			mode->update(elapsed);
 			kit::commit_mode();
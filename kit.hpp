@@ -28,6 +28,8 @@ namespace kit {
 		float hidden_update  = 0.0f;
 		float visible_update = 0.0f;
 		float active_update  = 0.0f;
+		//time to spend each frame on tasks posted with post_main_thread (e.g., GL uploads for background loads):
+		float main_thread_task_budget = 0.004f;
 	};
 }
 kit::Config kit_config(); //**YOU MUST DEFINE THIS***
@@ -1,40 +1,92 @@
 #include "load_cube.hpp"
 #include "rgbe.hpp"
 #include "load_save_png.hpp"
+#include "load_hdr.hpp"
 #include "gl_errors.hpp"
+#include "ThreadPool.hpp"
 
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
 
 //load an rgbe cubemap texture:
 GLuint load_cube(std::string const &filename) {
-	//assume cube is stacked faces +x,-x,+y,-y,+z,-z:
-	glm::uvec2 size;
-	std::vector< uint32_t > data;
-	if (!load_png(filename, &size.x, &size.y, &data, LowerLeftOrigin)) {
-		throw std::runtime_error("Failed to load '" + filename + "' as png.");
-	}
-	if (size.y != size.x * 6) {
-		throw std::runtime_error("Expecting stacked faces in cubemap.");
-	}
+	return upload_cube(load_cube_data(filename));
+}
+
+kit::CachedTexture load_cube_data(std::string const &filename) {
+	//the converted texture (with mipmaps) is kept in the texture cache (see texture_cache.hpp):
+	return kit::cached_texture(filename, "cube rgbe -> rgb9_e5 box mipmaps", [&](kit::CachedTexture *cube_) {
+		auto &cube = *cube_;
+
+		uint32_t size;
+		std::vector< uint32_t > data;
+		load_cube_faces(filename, &size, &data);
+
+		//the RGB9_E5 format is close to the source format and a lot more efficient to store than full floating point:
+		cube.target = GL_TEXTURE_CUBE_MAP;
+		cube.internal_format = GL_RGB9_E5;
+		cube.format = GL_RGB;
+		cube.type = GL_UNSIGNED_INT_5_9_9_9_REV;
+		cube.size = glm::uvec2(size);
+		cube.faces = 6;
+		cube.levels = 1;
+		while ((size >> cube.levels) > 0) cube.levels += 1;
+
+		auto level_size = [&](uint32_t level) { return std::max(1U, size >> level); };
+		{ //(so pointers from add_image stay valid)
+			size_t total = 0;
+			for (uint32_t level = 0; level < cube.levels; ++level) {
+				total += 6 * size_t(level_size(level)) * level_size(level) * 4;
+			}
+			cube.storage.reserve(total);
+		}
 
-	//convert from rgb+exponent to floating point:
-	std::vector< glm::vec3 > float_data;
-	float_data.reserve(data.size());
-	for (auto const &px : data) {
-		float_data.emplace_back(rgbe_to_float(*reinterpret_cast< glm::u8vec4 const * >(&px)));
+		//convert level zero straight from rgbe:
+		size_t face_pixels = size_t(size) * size;
+		std::vector< uint32_t * > faces;
+		for (uint32_t face = 0; face < 6; ++face) {
+			faces.emplace_back(reinterpret_cast< uint32_t * >(cube.add_image(face_pixels * 4)));
+		}
+		kit::thread_pool().parallel_for(6, [&](size_t face) {
+			rgbe_to_rgb9e5(reinterpret_cast< glm::u8vec4 const * >(data.data() + face * face_pixels), faces[face], face_pixels);
+		});
+		data = std::vector< uint32_t >();
+
+		//box-filter each level from the one above it:
+		for (uint32_t level = 1; level < cube.levels; ++level) {
+			uint32_t from_size = level_size(level - 1);
+			uint32_t to_size = level_size(level);
+			std::vector< uint32_t const * > from_faces(faces.begin(), faces.end());
+			for (uint32_t face = 0; face < 6; ++face) {
+				faces[face] = reinterpret_cast< uint32_t * >(cube.add_image(size_t(to_size) * to_size * 4));
+			}
+			kit::thread_pool().parallel_for(6, [&](size_t face) {
+				uint32_t const *from = from_faces[face];
+				uint32_t *to = faces[face];
+				for (uint32_t y = 0; y < to_size; ++y) {
+					for (uint32_t x = 0; x < to_size; ++x) {
+						uint32_t x0 = std::min(2 * x, from_size - 1), x1 = std::min(2 * x + 1, from_size - 1);
+						uint32_t y0 = std::min(2 * y, from_size - 1), y1 = std::min(2 * y + 1, from_size - 1);
+						glm::vec3 sum = rgb9e5_to_float(from[y0 * from_size + x0]) + rgb9e5_to_float(from[y0 * from_size + x1])
+						              + rgb9e5_to_float(from[y1 * from_size + x0]) + rgb9e5_to_float(from[y1 * from_size + x1]);
+						to[y * to_size + x] = float_to_rgb9e5(0.25f * sum);
+					}
+				}
+			});
+		}
+	});
+}
+
+GLuint upload_cube(kit::CachedTexture const &cube) {
+	if (cube.target != GL_TEXTURE_CUBE_MAP) {
+		throw std::runtime_error("Expecting cube map texture data.");
 	}
 
-	//upload to cubemap:
 	GLuint tex = 0;
 	glGenTextures(1, &tex);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
-	//the RGB9_E5 format is close to the source format and a lot more efficient to store than full floating point.
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB9_E5, size.x, size.x, 0, GL_RGB, GL_FLOAT, float_data.data() + 0*size.x*size.x);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB9_E5, size.x, size.x, 0, GL_RGB, GL_FLOAT, float_data.data() + 1*size.x*size.x);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB9_E5, size.x, size.x, 0, GL_RGB, GL_FLOAT, float_data.data() + 2*size.x*size.x);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB9_E5, size.x, size.x, 0, GL_RGB, GL_FLOAT, float_data.data() + 3*size.x*size.x);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB9_E5, size.x, size.x, 0, GL_RGB, GL_FLOAT, float_data.data() + 4*size.x*size.x);
-	glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB9_E5, size.x, size.x, 0, GL_RGB, GL_FLOAT, float_data.data() + 5*size.x*size.x);
+	cube.upload(tex); //(all levels are included, so no glGenerateMipmap)
 
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -44,8 +96,6 @@ GLuint load_cube(std::string const &filename) {
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
 	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
 	//NOTE: turning this on to enable nice filtering at cube map boundaries:
@@ -56,4 +106,121 @@ GLuint load_cube(std::string const &filename) {
 	return tex;
 }
 
+void load_cube_faces(std::string const &filename, uint32_t *size_, std::vector< uint32_t > *data_) {
+	assert(size_);
+	auto &size = *size_;
+	assert(data_);
+	auto &data = *data_;
 
+	glm::uvec2 image_size;
+	std::vector< uint32_t > image;
+	if (is_hdr_filename(filename)) {
+		if (!load_hdr(filename, &image_size.x, &image_size.y, &image, LowerLeftOrigin)) {
+			throw std::runtime_error("Failed to load '" + filename + "' as hdr.");
+		}
+	} else {
+		if (!load_png(filename, &image_size.x, &image_size.y, &image, LowerLeftOrigin)) {
+			throw std::runtime_error("Failed to load '" + filename + "' as png.");
+		}
+	}
+
+	//stacked faces are already in the right order:
+	if (image_size.y == image_size.x * 6) {
+		size = image_size.x;
+		data = std::move(image);
+		return;
+	}
+
+	//(other layouts are described from the top of the image down)
+	auto row_from_top = [&](uint32_t y) {
+		return image.data() + size_t(image_size.y - 1 - y) * image_size.x;
+	};
+
+	bool horizontal_cross = (image_size.x * 3 == image_size.y * 4 && image_size.x % 4 == 0);
+	bool vertical_cross = (image_size.x * 4 == image_size.y * 3 && image_size.x % 3 == 0);
+	if (horizontal_cross || vertical_cross) {
+		size = image_size.x / (horizontal_cross ? 4 : 3);
+		data.resize(6 * size_t(size) * size);
+
+		//block (column, row) of each face, and whether it is upside down:
+		struct Block { uint32_t column, row; bool flipped; };
+		Block const blocks[6] = {
+			{2, 1, false}, {0, 1, false},
+			{1, 0, false}, {1, 2, false},
+			{1, 1, false}, (horizontal_cross ? Block{3, 1, false} : Block{1, 3, true}),
+		};
+		kit::thread_pool().parallel_for(6, [&](size_t face) {
+			Block const &block = blocks[face];
+			for (uint32_t y = 0; y < size; ++y) {
+				uint32_t *to = data.data() + (face * size + y) * size;
+				if (!block.flipped) {
+					uint32_t const *from = row_from_top(block.row * size + y) + block.column * size;
+					std::copy(from, from + size, to);
+				} else {
+					uint32_t const *from = row_from_top(block.row * size + (size - 1 - y)) + block.column * size;
+					std::reverse_copy(from, from + size, to);
+				}
+			}
+		});
+		return;
+	}
+
+	if (image_size.x == image_size.y * 2) {
+		size = std::max(1U, image_size.x / 4);
+		data.resize(6 * size_t(size) * size);
+
+		//bilinear lookup, wrapping around horizontally:
+		auto lookup = [&](glm::vec2 at) {
+			at = at * glm::vec2(image_size) - 0.5f;
+			at.y = glm::clamp(at.y, 0.0f, float(image_size.y - 1));
+			glm::vec2 floor = glm::floor(at);
+			glm::vec2 amt = at - floor;
+			int32_t x0 = int32_t(floor.x);
+			uint32_t y0 = uint32_t(floor.y);
+			uint32_t y1 = std::min(y0 + 1, image_size.y - 1);
+			uint32_t x0w = uint32_t((x0 % int32_t(image_size.x) + int32_t(image_size.x)) % int32_t(image_size.x));
+			uint32_t x1w = (x0w + 1) % image_size.x;
+			auto px = [&](uint32_t x, uint32_t y) {
+				return rgbe_to_float(reinterpret_cast< glm::u8vec4 const & >(row_from_top(y)[x]));
+			};
+			return glm::mix(
+				glm::mix(px(x0w, y0), px(x1w, y0), amt.x),
+				glm::mix(px(x0w, y1), px(x1w, y1), amt.x),
+				amt.y
+			);
+		};
+
+		constexpr float Pi = 3.14159265358979323846f;
+		kit::thread_pool().parallel_for(6 * size, [&](size_t row) {
+			uint32_t face = uint32_t(row / size), y = uint32_t(row % size);
+			std::vector< glm::vec3 > colors(size);
+			for (uint32_t x = 0; x < size; ++x) {
+				glm::vec3 dir = cube_texel_direction(face, x, y, size);
+				glm::vec2 at;
+				at.x = 0.5f + std::atan2(dir.x, -dir.z) / (2.0f * Pi);
+				at.y = std::acos(glm::clamp(dir.y, -1.0f, 1.0f)) / Pi;
+				colors[x] = lookup(at);
+			}
+			float_to_rgbe(colors.data(), reinterpret_cast< glm::u8vec4 * >(data.data() + row * size), size);
+		});
+		return;
+	}
+
+	throw std::runtime_error("Expecting stacked faces, a cross, or an equirectangular image in cubemap '" + filename + "'.");
+}
+
+glm::vec3 cube_texel_direction(uint32_t face, uint32_t x, uint32_t y, uint32_t size) {
+	//(following the face orientation table in the GL spec)
+	float s = 2.0f * (x + 0.5f) / size - 1.0f;
+	float t = 2.0f * (y + 0.5f) / size - 1.0f;
+	glm::vec3 dir;
+	switch (face) {
+		case 0: dir = glm::vec3( 1.0f, -t, -s); break;
+		case 1: dir = glm::vec3(-1.0f, -t,  s); break;
+		case 2: dir = glm::vec3( s,  1.0f,  t); break;
+		case 3: dir = glm::vec3( s, -1.0f, -t); break;
+		case 4: dir = glm::vec3( s, -t,  1.0f); break;
+		default: dir = glm::vec3(-s, -t, -1.0f); break;
+	}
+	return glm::normalize(dir);
+}
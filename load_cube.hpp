@@ -3,8 +3,29 @@
 #include <string>
 
 #include <kit.hpp>
+#include "texture_cache.hpp"
 
 //load an (rgbe) cubemap texture:
 // returns a freshly allocated cube map texture on success
 // throws on failure
+//
+//'filename' may be an rgbe-encoded .png or a Radiance .hdr, in any of these layouts
+// (told apart by aspect ratio):
+//  - stacked faces (width x 6*width), +x,-x,+y,-y,+z,-z from the bottom of the image up
+//  - horizontal cross (4:3) with -x,+z,+x,-z across the middle, +y above and -y below +z
+//  - vertical cross (3:4) with -x,+z,+x across, +y above +z, and -y then -z (upside down) below it
+//  - equirectangular (2:1) with +y at the top and -z in the center (converted to faces of width/4)
 GLuint load_cube(std::string const &filename);
+
+//load_cube in two halves, for loading on a worker thread:
+// load_cube_data decodes the cube, converts it to RGB9_E5, and builds mipmaps (or reads all that from the texture cache)
+kit::CachedTexture load_cube_data(std::string const &filename);
+// upload_cube (main thread) makes a cube map texture from the result
+GLuint upload_cube(kit::CachedTexture const &cube);
+
+//decode any of the layouts above as stacked rgbe faces, in the order and orientation glTexImage2D wants them
+// (i.e., *data holds face f's row y at (f * size + y) * size):
+void load_cube_faces(std::string const &filename, uint32_t *size, std::vector< uint32_t > *data);
+
+//direction through the center of texel (x,y) of a face of a size x size cube map (as laid out by load_cube_faces):
+glm::vec3 cube_texel_direction(uint32_t face, uint32_t x, uint32_t y, uint32_t size);
@@ -0,0 +1,235 @@
+#include "load_hdr.hpp"
+#include "load_stats.hpp"
+#include "ThreadPool.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include <new>
+
+#define LOG_ERROR( X ) std::cerr << X << std::endl
+
+bool load_hdr(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin) {
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_hdr(file, width, height, data, origin);
+}
+
+bool is_hdr_filename(std::string const &filename) {
+	if (filename.size() < 4) return false;
+	std::string ext = filename.substr(filename.size() - 4);
+	for (auto &c : ext) c = char(std::tolower(c));
+	return ext == ".hdr";
+}
+
+//decode one scanline starting at 'at' into 'out' (width rgbe pixels), or just skip over it if 'out' is null:
+// returns the start of the next scanline, or null if the data is malformed.
+static uint8_t const *decode_scanline(uint8_t const *at, uint8_t const *end, uint32_t width, uint8_t *out) {
+	//"new" run-length encoding: marker, then each channel in turn as runs and literals:
+	if (width >= 8 && width <= 0x7fff && end - at >= 4 && at[0] == 2 && at[1] == 2 && !(at[2] & 0x80)) {
+		if ((uint32_t(at[2]) << 8 | at[3]) != width) return nullptr;
+		at += 4;
+		for (uint32_t channel = 0; channel < 4; ++channel) {
+			uint32_t x = 0;
+			while (x < width) {
+				if (at == end) return nullptr;
+				uint32_t count = *at;
+				++at;
+				if (count > 128) { //run
+					count -= 128;
+					if (count > width - x || at == end) return nullptr;
+					if (out) {
+						for (uint32_t i = 0; i < count; ++i) out[4 * (x + i) + channel] = *at;
+					}
+					at += 1;
+				} else { //literal
+					if (count == 0 || count > width - x || uint32_t(end - at) < count) return nullptr;
+					if (out) {
+						for (uint32_t i = 0; i < count; ++i) out[4 * (x + i) + channel] = at[i];
+					}
+					at += count;
+				}
+				x += count;
+			}
+		}
+		return at;
+	}
+
+	//flat pixels, possibly with "old" run-length encoding (1,1,1,count repeats the previous pixel):
+	uint32_t shift = 0;
+	uint32_t x = 0;
+	while (x < width) {
+		if (end - at < 4) return nullptr;
+		if (at[0] == 1 && at[1] == 1 && at[2] == 1) {
+			if (x == 0 || shift > 24) return nullptr;
+			uint32_t count = uint32_t(at[3]) << shift;
+			if (count > width - x) return nullptr;
+			if (out) {
+				for (uint32_t i = 0; i < count; ++i) std::memcpy(out + 4 * (x + i), out + 4 * (x - 1), 4);
+			}
+			x += count;
+			shift += 8;
+		} else {
+			if (out) std::memcpy(out + 4 * x, at, 4);
+			x += 1;
+			shift = 0;
+		}
+		at += 4;
+	}
+	return at;
+}
+
+bool load_hdr(std::istream &from, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin) {
+	assert(data);
+	uint32_t local_width, local_height;
+	if (width == nullptr) width = &local_width;
+	if (height == nullptr) height = &local_height;
+	*width = *height = 0;
+	data->clear();
+
+	std::vector< uint8_t > file;
+	{
+		std::vector< char > buffer(1 << 20);
+		while (from) {
+			from.read(buffer.data(), buffer.size());
+			std::streamsize got = from.gcount();
+			if (got <= 0) break;
+			file.insert(file.end(), buffer.begin(), buffer.begin() + got);
+		}
+		if (from.bad()) {
+			LOG_ERROR("  error reading.");
+			return false;
+		}
+		kit::count_bytes_read(file.size());
+	}
+	uint8_t const *at = file.data();
+	uint8_t const *end = file.data() + file.size();
+
+	auto read_line = [&](std::string *line) {
+		if (at == end) return false;
+		uint8_t const *newline = static_cast< uint8_t const * >(std::memchr(at, '\n', end - at));
+		if (!newline) return false;
+		line->assign(at, newline);
+		at = newline + 1;
+		return true;
+	};
+
+	//header: magic line, then variables, then a blank line:
+	std::string line;
+	if (!read_line(&line) || line.compare(0, 2, "#?") != 0) {
+		LOG_ERROR("  not a Radiance hdr file.");
+		return false;
+	}
+	while (true) {
+		if (!read_line(&line)) {
+			LOG_ERROR("  unterminated hdr header.");
+			return false;
+		}
+		if (line.empty()) break;
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+			LOG_ERROR("  unsupported hdr format '" << line.substr(7) << "' (only 32-bit_rle_rgbe is supported).");
+			return false;
+		}
+	}
+
+	//resolution string; only the usual (unrotated) orientations are supported:
+	bool top_down;
+	uint32_t w, h;
+	{
+		char y_axis[3], x_axis[3];
+		unsigned int y_size, x_size;
+		if (!read_line(&line) || std::sscanf(line.c_str(), "%2s %u %2s %u", y_axis, &y_size, x_axis, &x_size) != 4
+		 || std::string(x_axis) != "+X" || (std::string(y_axis) != "-Y" && std::string(y_axis) != "+Y")) {
+			LOG_ERROR("  unsupported hdr resolution string '" << line << "'.");
+			return false;
+		}
+		if (x_size == 0 || y_size == 0) {
+			LOG_ERROR("  empty hdr image.");
+			return false;
+		}
+		top_down = (std::string(y_axis) == "-Y");
+		w = x_size;
+		h = y_size;
+	}
+
+	//every scanline takes at least 4 bytes (a "new" rle marker, a flat pixel, or an "old" rle run),
+	// so reject sizes the remaining data can't hold before doing anything else:
+	if (uint64_t(h) * 4 > uint64_t(end - at)) {
+		LOG_ERROR("  hdr image of " << w << "x" << h << " is larger than the data in the file.");
+		return false;
+	}
+	//...but "old" rle runs can cover billions of pixels in a few bytes, so also cap the total size:
+	if (uint64_t(w) * h > MaxHdrPixels) {
+		LOG_ERROR("  hdr image of " << w << "x" << h << " has more than " << MaxHdrPixels << " pixels.");
+		return false;
+	}
+
+	//find where each block of scanlines starts; this parses all of the data, so malformed files
+	// are rejected before the output is allocated:
+	constexpr uint32_t BlockRows = 64;
+	std::vector< uint8_t const * > block_starts;
+	for (uint32_t i = 0; i < h; ++i) {
+		if (i % BlockRows == 0) block_starts.emplace_back(at);
+		at = decode_scanline(at, end, w, nullptr);
+		if (!at) {
+			LOG_ERROR("  malformed hdr scanline " << i << ".");
+			return false;
+		}
+	}
+
+	std::vector< uint32_t > pixels;
+	try {
+		pixels.resize(size_t(w) * h);
+	} catch (std::bad_alloc &) {
+		LOG_ERROR("  not enough memory for hdr image of " << w << "x" << h << ".");
+		return false;
+	}
+	//row of the output that holds scanline 'i' of the file:
+	auto output_row = [&](uint32_t i) {
+		uint32_t from_top = (top_down ? i : h - 1 - i);
+		return (origin == UpperLeftOrigin ? from_top : h - 1 - from_top);
+	};
+	auto row_data = [&](uint32_t i) {
+		return reinterpret_cast< uint8_t * >(pixels.data() + size_t(output_row(i)) * w);
+	};
+	auto decode_block = [&](size_t block) {
+		uint8_t const *block_at = block_starts[block];
+		uint32_t last = std::min< uint32_t >(h, uint32_t(block + 1) * BlockRows);
+		for (uint32_t i = uint32_t(block) * BlockRows; i < last && block_at; ++i) {
+			block_at = decode_scanline(block_at, end, w, row_data(i));
+		}
+		return block_at != nullptr;
+	};
+
+	bool failed = false;
+	if (size_t(w) * h < (1 << 16) || h <= BlockRows) {
+		//small image: just decode in order:
+		for (size_t block = 0; block < block_starts.size() && !failed; ++block) {
+			failed = !decode_block(block);
+		}
+	} else {
+		//large image: decode the blocks in parallel:
+		std::atomic< bool > any_failed(false);
+		kit::thread_pool().parallel_for(block_starts.size(), [&](size_t block) {
+			if (!decode_block(block)) any_failed = true;
+		});
+		failed = any_failed;
+	}
+	if (failed) { //(shouldn't happen, since the locating pass already parsed everything)
+		LOG_ERROR("  malformed hdr data.");
+		return false;
+	}
+
+	*data = std::move(pixels);
+	*width = w;
+	*height = h;
+	return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <stdint.h>
+
+/*
+ * Load Radiance .hdr (rgbe) files.
+ *
+ * Pixels are returned as rgbe bytes (r,g,b,e in memory order), i.e., in the same
+ *  form as an rgbe-encoded png from load_png; decode them with the functions in rgbe.hpp.
+ *
+ * Both run-length encoded and flat scanlines are supported. A quick pass first
+ *  finds where each scanline starts (so malformed data is rejected before the
+ *  image is allocated); large images are then decoded in blocks of scanlines
+ *  on kit::thread_pool().
+ */
+
+#ifndef LOAD_SAVE_ORIGIN
+#define LOAD_SAVE_ORIGIN
+enum OriginLocation {
+	LowerLeftOrigin,
+	UpperLeftOrigin,
+};
+#endif
+
+//images with more pixels than this are rejected (a few bytes of "old" rle can claim billions):
+constexpr uint64_t MaxHdrPixels = uint64_t(1) << 28; //(1 GiB of rgbe data)
+
+bool load_hdr(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin);
+
+bool load_hdr(std::istream &from, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
+
+//true if 'filename' ends in ".hdr" (in any case):
+bool is_hdr_filename(std::string const &filename);
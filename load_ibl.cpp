@@ -0,0 +1,452 @@
+#include "load_ibl.hpp"
+#include "load_cube.hpp"
+#include "rgbe.hpp"
+#include "ThreadPool.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define IBL_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define IBL_AVX 1 //(compiled with a target attribute, used if the CPU supports it)
+#include <immintrin.h>
+#endif
+#endif
+
+namespace {
+	constexpr float Pi = 3.14159265358979323846f;
+
+	//one level of a floating point cube map (faces +x,-x,+y,-y,+z,-z; rows in texture order):
+	struct FloatCube {
+		uint32_t size = 0;
+		std::vector< glm::vec3 > texels; //6 * size * size
+		glm::vec3 &at(uint32_t face, uint32_t x, uint32_t y) { return texels[(face * size + y) * size + x]; }
+		glm::vec3 const &at(uint32_t face, uint32_t x, uint32_t y) const { return texels[(face * size + y) * size + x]; }
+	};
+
+	//solid angle covered by a texel:
+	float texel_solid_angle(uint32_t x, uint32_t y, uint32_t size) {
+		auto area = [](float s, float t) { return std::atan2(s * t, std::sqrt(s * s + t * t + 1.0f)); };
+		float s0 = 2.0f * x / size - 1.0f, s1 = 2.0f * (x + 1) / size - 1.0f;
+		float t0 = 2.0f * y / size - 1.0f, t1 = 2.0f * (y + 1) / size - 1.0f;
+		return area(s0, t0) - area(s0, t1) - area(s1, t0) + area(s1, t1);
+	}
+
+	//bilinear lookup (clamped to the face the direction points at):
+	glm::vec3 sample(FloatCube const &cube, glm::vec3 dir) {
+		glm::vec3 a = glm::abs(dir);
+		uint32_t face;
+		float sc, tc, ma;
+		if (a.x >= a.y && a.x >= a.z) {
+			face = (dir.x > 0.0f ? 0 : 1);
+			sc = (dir.x > 0.0f ? -dir.z : dir.z); tc = -dir.y; ma = a.x;
+		} else if (a.y >= a.z) {
+			face = (dir.y > 0.0f ? 2 : 3);
+			sc = dir.x; tc = (dir.y > 0.0f ? dir.z : -dir.z); ma = a.y;
+		} else {
+			face = (dir.z > 0.0f ? 4 : 5);
+			sc = (dir.z > 0.0f ? dir.x : -dir.x); tc = -dir.y; ma = a.z;
+		}
+		float u = (0.5f * (sc / ma) + 0.5f) * cube.size - 0.5f;
+		float v = (0.5f * (tc / ma) + 0.5f) * cube.size - 0.5f;
+		u = glm::clamp(u, 0.0f, float(cube.size - 1));
+		v = glm::clamp(v, 0.0f, float(cube.size - 1));
+		uint32_t x0 = uint32_t(u), y0 = uint32_t(v);
+		uint32_t x1 = std::min(x0 + 1, cube.size - 1), y1 = std::min(y0 + 1, cube.size - 1);
+		float fx = u - x0, fy = v - y0;
+		return glm::mix(
+			glm::mix(cube.at(face, x0, y0), cube.at(face, x1, y0), fx),
+			glm::mix(cube.at(face, x0, y1), cube.at(face, x1, y1), fx),
+			fy
+		);
+	}
+
+	//trilinear lookup in a mip chain:
+	glm::vec3 sample(std::vector< FloatCube > const &chain, glm::vec3 dir, float lod) {
+		lod = glm::clamp(lod, 0.0f, float(chain.size() - 1));
+		uint32_t l0 = uint32_t(lod);
+		uint32_t l1 = std::min(l0 + 1, uint32_t(chain.size() - 1));
+		glm::vec3 c0 = sample(chain[l0], dir);
+		if (l1 == l0) return c0;
+		return glm::mix(c0, sample(chain[l1], dir), lod - l0);
+	}
+
+	FloatCube half_size(FloatCube const &from) {
+		FloatCube to;
+		to.size = std::max(1U, from.size / 2);
+		to.texels.resize(6 * to.size * to.size);
+		kit::thread_pool().parallel_for(6 * to.size, [&](size_t row) {
+			uint32_t face = uint32_t(row / to.size), y = uint32_t(row % to.size);
+			for (uint32_t x = 0; x < to.size; ++x) {
+				uint32_t x0 = std::min(2 * x, from.size - 1), x1 = std::min(2 * x + 1, from.size - 1);
+				uint32_t y0 = std::min(2 * y, from.size - 1), y1 = std::min(2 * y + 1, from.size - 1);
+				to.at(face, x, y) = 0.25f * (from.at(face, x0, y0) + from.at(face, x1, y0) + from.at(face, x0, y1) + from.at(face, x1, y1));
+			}
+		});
+		return to;
+	}
+
+	//decode an rgbe cube as a floating point mip chain, starting at no more than about 'max_size' per face:
+	std::vector< FloatCube > load_float_chain(std::string const &filename, uint32_t max_size) {
+		uint32_t size;
+		std::vector< uint32_t > data;
+		load_cube_faces(filename, &size, &data);
+
+		//box-filter by 'step' while decoding, so large sources are never expanded to floats in full:
+		uint32_t step = std::max(1U, size / std::max(1U, max_size));
+		while (step > 1 && size % step != 0) step -= 1;
+
+		std::vector< FloatCube > chain(1);
+		FloatCube &base = chain[0];
+		base.size = size / step;
+		base.texels.resize(6 * base.size * base.size, glm::vec3(0.0f));
+		kit::thread_pool().parallel_for(6 * base.size, [&](size_t row) {
+			std::vector< glm::vec3 > decoded(size);
+			glm::vec3 *out = &base.texels[row * base.size];
+			for (uint32_t i = 0; i < step; ++i) {
+				size_t source_row = row * step + i; //(faces are stacked, so rows continue across faces)
+				rgbe_to_float(reinterpret_cast< glm::u8vec4 const * >(data.data() + source_row * size), decoded.data(), size);
+				for (uint32_t x = 0; x < base.size; ++x) {
+					for (uint32_t j = 0; j < step; ++j) {
+						out[x] += decoded[x * step + j];
+					}
+				}
+			}
+			float scale = 1.0f / float(step * step);
+			for (uint32_t x = 0; x < base.size; ++x) {
+				out[x] *= scale;
+			}
+		});
+		data = std::vector< uint32_t >();
+
+		while (chain.back().size > 1) {
+			chain.emplace_back(half_size(chain.back()));
+		}
+		return chain;
+	}
+
+	//pack floating point levels into an RGB9_E5 cube:
+	void pack_cube(std::vector< FloatCube > const &levels, kit::CachedTexture *cube_) {
+		assert(cube_);
+		auto &cube = *cube_;
+		cube.target = GL_TEXTURE_CUBE_MAP;
+		cube.internal_format = GL_RGB9_E5;
+		cube.format = GL_RGB;
+		cube.type = GL_UNSIGNED_INT_5_9_9_9_REV;
+		cube.size = glm::uvec2(levels[0].size);
+		cube.faces = 6;
+		cube.levels = uint32_t(levels.size());
+		for (auto const &level : levels) {
+			for (uint32_t face = 0; face < 6; ++face) {
+				size_t count = size_t(level.size) * level.size;
+				uint32_t *to = reinterpret_cast< uint32_t * >(cube.add_image(count * 4));
+				glm::vec3 const *from = &level.texels[face * count];
+				for (size_t i = 0; i < count; ++i) {
+					to[i] = float_to_rgb9e5(from[i]);
+				}
+			}
+		}
+	}
+
+	//source texels for the irradiance integral, with radiance pre-multiplied by solid angle:
+	struct IrradianceSource {
+		std::vector< float > dx, dy, dz; //direction
+		std::vector< float > r, g, b; //radiance * solid angle
+	};
+
+	//the irradiance sum is a reduction, which compilers won't vectorize without reassociating,
+	// so the SIMD versions keep explicit per-lane partial sums (and return how many texels they did):
+	void irradiance_sum_scalar(IrradianceSource const &src, size_t begin, glm::vec3 n, glm::vec3 *sum) {
+		for (size_t i = begin; i < src.dx.size(); ++i) {
+			float c = std::max(0.0f, n.x * src.dx[i] + n.y * src.dy[i] + n.z * src.dz[i]);
+			*sum += c * glm::vec3(src.r[i], src.g[i], src.b[i]);
+		}
+	}
+
+	#if IBL_SSE2
+	inline float add_lanes(__m128 v) {
+		float lanes[4];
+		_mm_storeu_ps(lanes, v);
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+
+	size_t irradiance_sum_sse2(IrradianceSource const &src, size_t begin, glm::vec3 n, glm::vec3 *sum) {
+		__m128 const zero = _mm_setzero_ps();
+		__m128 const nx = _mm_set1_ps(n.x), ny = _mm_set1_ps(n.y), nz = _mm_set1_ps(n.z);
+		__m128 sr = zero, sg = zero, sb = zero;
+		size_t i = begin;
+		for (; i + 4 <= src.dx.size(); i += 4) {
+			__m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(&src.dx[i])), _mm_mul_ps(ny, _mm_loadu_ps(&src.dy[i]))), _mm_mul_ps(nz, _mm_loadu_ps(&src.dz[i])));
+			c = _mm_max_ps(c, zero);
+			sr = _mm_add_ps(sr, _mm_mul_ps(c, _mm_loadu_ps(&src.r[i])));
+			sg = _mm_add_ps(sg, _mm_mul_ps(c, _mm_loadu_ps(&src.g[i])));
+			sb = _mm_add_ps(sb, _mm_mul_ps(c, _mm_loadu_ps(&src.b[i])));
+		}
+		*sum += glm::vec3(add_lanes(sr), add_lanes(sg), add_lanes(sb));
+		return i - begin;
+	}
+	#endif //IBL_SSE2
+
+	#if IBL_AVX
+	__attribute__((target("avx")))
+	inline float add_lanes_avx(__m256 v) {
+		return add_lanes(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+	}
+
+	__attribute__((target("avx")))
+	size_t irradiance_sum_avx(IrradianceSource const &src, size_t begin, glm::vec3 n, glm::vec3 *sum) {
+		__m256 const zero = _mm256_setzero_ps();
+		__m256 const nx = _mm256_set1_ps(n.x), ny = _mm256_set1_ps(n.y), nz = _mm256_set1_ps(n.z);
+		__m256 sr = zero, sg = zero, sb = zero;
+		size_t i = begin;
+		for (; i + 8 <= src.dx.size(); i += 8) {
+			__m256 c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(&src.dx[i])), _mm256_mul_ps(ny, _mm256_loadu_ps(&src.dy[i]))), _mm256_mul_ps(nz, _mm256_loadu_ps(&src.dz[i])));
+			c = _mm256_max_ps(c, zero);
+			sr = _mm256_add_ps(sr, _mm256_mul_ps(c, _mm256_loadu_ps(&src.r[i])));
+			sg = _mm256_add_ps(sg, _mm256_mul_ps(c, _mm256_loadu_ps(&src.g[i])));
+			sb = _mm256_add_ps(sb, _mm256_mul_ps(c, _mm256_loadu_ps(&src.b[i])));
+		}
+		*sum += glm::vec3(add_lanes_avx(sr), add_lanes_avx(sg), add_lanes_avx(sb));
+		return i - begin;
+	}
+
+	bool has_avx() {
+		static bool avx = __builtin_cpu_supports("avx");
+		return avx;
+	}
+	#endif //IBL_AVX
+
+	//sum of max(0, n . d) * radiance over every source texel:
+	glm::vec3 irradiance_sum(IrradianceSource const &src, glm::vec3 n) {
+		glm::vec3 sum(0.0f);
+		size_t done = 0;
+		#if IBL_AVX
+		if (has_avx()) done = irradiance_sum_avx(src, 0, n, &sum);
+		#endif
+		#if IBL_SSE2
+		done += irradiance_sum_sse2(src, done, n, &sum);
+		#endif
+		irradiance_sum_scalar(src, done, n, &sum);
+		return sum;
+	}
+
+	//i-th of n points in the Hammersley set:
+	glm::vec2 hammersley(uint32_t i, uint32_t n) {
+		uint32_t bits = i;
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xaaaaaaaau) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xccccccccu) >> 2);
+		bits = ((bits & 0x0f0f0f0fu) << 4) | ((bits & 0xf0f0f0f0u) >> 4);
+		bits = ((bits & 0x00ff00ffu) << 8) | ((bits & 0xff00ff00u) >> 8);
+		return glm::vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10f);
+	}
+}
+
+kit::CachedTexture load_cube_specular_data(std::string const &filename, uint32_t size, uint32_t levels, uint32_t samples) {
+	if (size == 0 || levels == 0 || samples == 0) {
+		throw std::runtime_error("Expecting non-zero size, levels, and samples for specular cube.");
+	}
+	levels = std::min(levels, 1 + uint32_t(std::log2(float(size))));
+	std::string params = "ibl specular ggx size=" + std::to_string(size) + " levels=" + std::to_string(levels) + " samples=" + std::to_string(samples);
+
+	return kit::cached_texture(filename, params, [&](kit::CachedTexture *cube) {
+		//(sampling from a source a bit larger than the output keeps roughness-zero reflections sharp)
+		std::vector< FloatCube > chain = load_float_chain(filename, 2 * size);
+		float texel_solid_angle = 4.0f * Pi / (6.0f * chain[0].size * chain[0].size);
+
+		std::vector< FloatCube > out(levels);
+		for (uint32_t level = 0; level < levels; ++level) {
+			FloatCube &target = out[level];
+			target.size = std::max(1U, size >> level);
+			target.texels.resize(6 * target.size * target.size);
+
+			float roughness = (levels > 1 ? float(level) / float(levels - 1) : 0.0f);
+			float alpha = roughness * roughness;
+
+			//sample directions (in tangent space, with N = V = +z) don't depend on the texel, so make them once:
+			// (the per-texel loop below is scalar -- each sample picks a face and does a bilinear lookup --
+			//  so the work is spread over threads rather than SIMD lanes)
+			std::vector< float > lx, ly, lz, weight, lod;
+			if (alpha == 0.0f) {
+				lx.emplace_back(0.0f); ly.emplace_back(0.0f); lz.emplace_back(1.0f);
+				weight.emplace_back(1.0f);
+				lod.emplace_back(std::log2(float(chain[0].size) / float(target.size)));
+			} else {
+				float alpha2 = alpha * alpha;
+				for (uint32_t i = 0; i < samples; ++i) {
+					glm::vec2 xi = hammersley(i, samples);
+					float phi = 2.0f * Pi * xi.x;
+					float cos_theta = std::sqrt((1.0f - xi.y) / (1.0f + (alpha2 - 1.0f) * xi.y));
+					float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+					glm::vec3 h = glm::vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+					glm::vec3 l = 2.0f * cos_theta * h - glm::vec3(0.0f, 0.0f, 1.0f);
+					if (l.z <= 0.0f) continue;
+					//pick a source level whose texels match the sample's share of the lobe ("filtered importance sampling"):
+					float d = alpha2 / (Pi * std::pow(cos_theta * cos_theta * (alpha2 - 1.0f) + 1.0f, 2.0f));
+					float pdf = d * 0.25f; //(D * NdotH / (4 * VdotH), with N = V)
+					float sample_solid_angle = 1.0f / (float(samples) * pdf);
+					lx.emplace_back(l.x); ly.emplace_back(l.y); lz.emplace_back(l.z);
+					weight.emplace_back(l.z);
+					lod.emplace_back(std::max(0.0f, 0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.0f));
+				}
+			}
+
+			kit::thread_pool().parallel_for(6 * target.size, [&](size_t row) {
+				uint32_t face = uint32_t(row / target.size), y = uint32_t(row % target.size);
+				for (uint32_t x = 0; x < target.size; ++x) {
+					glm::vec3 n = cube_texel_direction(face, x, y, target.size);
+					glm::vec3 up = (std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f));
+					glm::vec3 t = glm::normalize(glm::cross(up, n));
+					glm::vec3 b = glm::cross(n, t);
+					glm::vec3 sum = glm::vec3(0.0f);
+					float total = 0.0f;
+					for (size_t i = 0; i < lx.size(); ++i) {
+						glm::vec3 l = t * lx[i] + b * ly[i] + n * lz[i];
+						sum += weight[i] * sample(chain, l, lod[i]);
+						total += weight[i];
+					}
+					target.at(face, x, y) = sum / total;
+				}
+			});
+		}
+
+		pack_cube(out, cube);
+	});
+}
+
+GLuint load_cube_specular(std::string const &filename, uint32_t size, uint32_t levels, uint32_t samples) {
+	return upload_cube(load_cube_specular_data(filename, size, levels, samples));
+}
+
+kit::CachedTexture load_cube_irradiance_data(std::string const &filename, uint32_t size) {
+	if (size == 0) {
+		throw std::runtime_error("Expecting non-zero size for irradiance cube.");
+	}
+	std::string params = "ibl irradiance size=" + std::to_string(size);
+
+	return kit::cached_texture(filename, params, [&](kit::CachedTexture *cube) {
+		//irradiance is very smooth, so integrate over a small version of the source:
+		std::vector< FloatCube > chain = load_float_chain(filename, 64);
+		FloatCube const *source = &chain[0];
+		for (auto const &level : chain) {
+			if (level.size >= 16) source = &level;
+		}
+
+		//every source texel, with its radiance pre-multiplied by its solid angle:
+		IrradianceSource src;
+		for (uint32_t face = 0; face < 6; ++face) {
+			for (uint32_t y = 0; y < source->size; ++y) {
+				for (uint32_t x = 0; x < source->size; ++x) {
+					glm::vec3 dir = cube_texel_direction(face, x, y, source->size);
+					glm::vec3 light = source->at(face, x, y) * texel_solid_angle(x, y, source->size);
+					src.dx.emplace_back(dir.x); src.dy.emplace_back(dir.y); src.dz.emplace_back(dir.z);
+					src.r.emplace_back(light.r); src.g.emplace_back(light.g); src.b.emplace_back(light.b);
+				}
+			}
+		}
+
+		std::vector< FloatCube > out(1);
+		FloatCube &target = out[0];
+		target.size = size;
+		target.texels.resize(6 * size * size);
+		kit::thread_pool().parallel_for(6 * size, [&](size_t row) {
+			uint32_t face = uint32_t(row / size), y = uint32_t(row % size);
+			for (uint32_t x = 0; x < size; ++x) {
+				glm::vec3 n = cube_texel_direction(face, x, y, size);
+				target.at(face, x, y) = irradiance_sum(src, n) / Pi;
+			}
+		});
+
+		pack_cube(out, cube);
+	});
+}
+
+GLuint load_cube_irradiance(std::string const &filename, uint32_t size) {
+	return upload_cube(load_cube_irradiance_data(filename, size));
+}
+
+namespace {
+	//real spherical harmonics basis functions (without the constant factors) for unit direction 'd':
+	void sh9_basis(glm::vec3 const &d, float *out) {
+		out[0] = 1.0f;
+		out[1] = d.y;
+		out[2] = d.z;
+		out[3] = d.x;
+		out[4] = d.x * d.y;
+		out[5] = d.y * d.z;
+		out[6] = 3.0f * d.z * d.z - 1.0f;
+		out[7] = d.x * d.z;
+		out[8] = d.x * d.x - d.y * d.y;
+	}
+
+	//constant factor of each basis function:
+	constexpr float SH9Scale[9] = {
+		0.282094792f,
+		0.488602512f, 0.488602512f, 0.488602512f,
+		1.092548431f, 1.092548431f, 0.315391565f, 1.092548431f, 0.546274215f,
+	};
+
+	//convolution with a clamped cosine lobe, divided by pi (per band: pi, 2pi/3, pi/4):
+	constexpr float SH9Cosine[9] = {
+		1.0f,
+		2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+		0.25f, 0.25f, 0.25f, 0.25f, 0.25f,
+	};
+}
+
+glm::vec3 SH9::irradiance(glm::vec3 const &n) const {
+	Uniforms folded = uniforms();
+	float basis[9];
+	sh9_basis(n, basis);
+	glm::vec3 sum = glm::vec3(0.0f);
+	for (uint32_t i = 0; i < 9; ++i) {
+		sum += glm::vec3(folded.u[i]) * basis[i];
+	}
+	return sum;
+}
+
+SH9::Uniforms SH9::uniforms() const {
+	Uniforms ret;
+	for (uint32_t i = 0; i < 9; ++i) {
+		ret.u[i] = glm::vec4(coefficients[i] * (SH9Scale[i] * SH9Cosine[i]), 0.0f);
+	}
+	return ret;
+}
+
+SH9 load_cube_sh9(std::string const &filename) {
+	uint32_t size;
+	std::vector< uint32_t > data;
+	load_cube_faces(filename, &size, &data);
+
+	//each row is decoded and projected separately, then rows are summed in order (so the result doesn't depend on scheduling):
+	uint32_t rows = 6 * size;
+	std::vector< glm::vec3 > partial(size_t(rows) * 9, glm::vec3(0.0f));
+	kit::thread_pool().parallel_for(rows, [&](size_t row) {
+		uint32_t face = uint32_t(row / size), y = uint32_t(row % size);
+		std::vector< glm::vec3 > decoded(size);
+		rgbe_to_float(reinterpret_cast< glm::u8vec4 const * >(data.data() + row * size), decoded.data(), size);
+		glm::vec3 *sum = &partial[row * 9];
+		float basis[9];
+		for (uint32_t x = 0; x < size; ++x) {
+			sh9_basis(cube_texel_direction(face, x, y, size), basis);
+			glm::vec3 light = decoded[x] * texel_solid_angle(x, y, size);
+			for (uint32_t i = 0; i < 9; ++i) {
+				sum[i] += light * basis[i];
+			}
+		}
+	});
+
+	SH9 sh;
+	for (uint32_t i = 0; i < 9; ++i) {
+		glm::vec3 total = glm::vec3(0.0f);
+		for (uint32_t row = 0; row < rows; ++row) {
+			total += partial[row * 9 + i];
+		}
+		sh.coefficients[i] = total * SH9Scale[i];
+	}
+	return sh;
+}
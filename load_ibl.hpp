@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+#include <kit.hpp>
+#include "texture_cache.hpp"
+
+//Image-based lighting maps, prefiltered on the CPU from an rgbe cubemap (in any layout load_cube supports).
+//
+//The prefiltering runs on kit::thread_pool() and goes through the texture cache, so it only
+// happens the first time a given source (and set of parameters) is loaded.
+//Like load_cube_data, the *_data functions are safe to call on a worker thread; upload results with upload_cube.
+
+//specular (GGX) cube: level l is prefiltered for perceptual roughness l / (levels - 1),
+// so shaders can use textureLod(cube, R, roughness * (levels - 1)).
+// (assumes N = V = R when prefiltering, as in the "split sum" approximation)
+kit::CachedTexture load_cube_specular_data(std::string const &filename, uint32_t size = 128, uint32_t levels = 6, uint32_t samples = 256);
+GLuint load_cube_specular(std::string const &filename, uint32_t size = 128, uint32_t levels = 6, uint32_t samples = 256);
+
+//diffuse irradiance cube: the cosine-weighted integral of incoming light, divided by pi
+// (i.e., the light reflected by a white lambertian surface; multiply by albedo).
+kit::CachedTexture load_cube_irradiance_data(std::string const &filename, uint32_t size = 32);
+GLuint load_cube_irradiance(std::string const &filename, uint32_t size = 32);
+
+//diffuse ambient light as 9 (order 2) spherical harmonics coefficients, projected from an rgbe cubemap
+// (in any layout load_cube supports) in one parallel pass over its texels:
+struct SH9 {
+	//radiance coefficients, in the order (l,m) = (0,0), (1,-1), (1,0), (1,1), (2,-2), (2,-1), (2,0), (2,1), (2,2):
+	glm::vec3 coefficients[9];
+
+	//irradiance / pi (same meaning as load_cube_irradiance) for unit normal 'n':
+	glm::vec3 irradiance(glm::vec3 const &n) const;
+
+	//uniform-ready form, with basis and cosine-lobe constants folded in; evaluate with:
+	//  vec3 c = u[0] + u[1]*n.y + u[2]*n.z + u[3]*n.x + u[4]*n.x*n.y + u[5]*n.y*n.z
+	//         + u[6]*(3.0*n.z*n.z - 1.0) + u[7]*n.x*n.z + u[8]*(n.x*n.x - n.y*n.y);
+	// (vec4 rather than vec3 so the array has the same layout as a std140 vec4[9]; .w is zero)
+	struct Uniforms {
+		glm::vec4 u[9];
+	};
+	Uniforms uniforms() const;
+};
+
+SH9 load_cube_sh9(std::string const &filename);
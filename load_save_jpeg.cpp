@@ -1,4 +1,5 @@
 #include "load_save_jpeg.hpp"
+#include "load_stats.hpp"
 
 #include <jpeglib.h>
 #include <jerror.h>
@@ -7,6 +8,8 @@
 #include <fstream>
 #include <cassert>
 #include <algorithm>
+#include <functional>
+#include <memory>
 
 struct stream_source_mgr : jpeg_source_mgr {
 	std::istream &stream;
@@ -44,6 +47,7 @@ struct stream_source_mgr : jpeg_source_mgr {
 		}
 		next_input_byte = buffer.data();
 		bytes_in_buffer = buffer.size();
+		kit::count_bytes_read(buffer.size());
 
 		return TRUE;
 	}
@@ -71,6 +75,44 @@ struct stream_source_mgr : jpeg_source_mgr {
 	}
 };
 
+struct stream_destination_mgr : jpeg_destination_mgr {
+	std::ostream &stream;
+	std::vector< JOCTET > buffer;
+
+	stream_destination_mgr(jpeg_compress_struct *cinfo, std::ostream &stream_) : stream(stream_), buffer(1 << 16) {
+		next_output_byte = buffer.data();
+		free_in_buffer = buffer.size();
+		init_destination = init_destination_static;
+		empty_output_buffer = empty_output_buffer_static;
+		term_destination = term_destination_static;
+
+		cinfo->dest = this;
+	}
+
+	static void init_destination_static(j_compress_ptr cinfo) {
+		//Do nothing.
+	}
+
+	//(libjpeg calls this when the buffer is full, ignoring next_output_byte and free_in_buffer)
+	static boolean empty_output_buffer_static(j_compress_ptr cinfo) {
+		stream_destination_mgr *self = reinterpret_cast< stream_destination_mgr * >(cinfo->dest);
+		if (!self->stream.write(reinterpret_cast< char const * >(self->buffer.data()), self->buffer.size())) {
+			ERREXIT( cinfo, JERR_FILE_WRITE );
+		}
+		self->next_output_byte = self->buffer.data();
+		self->free_in_buffer = self->buffer.size();
+		return TRUE;
+	}
+
+	static void term_destination_static(j_compress_ptr cinfo) {
+		stream_destination_mgr *self = reinterpret_cast< stream_destination_mgr * >(cinfo->dest);
+		size_t count = self->buffer.size() - self->free_in_buffer;
+		if (!self->stream.write(reinterpret_cast< char const * >(self->buffer.data()), count) || !self->stream.flush()) {
+			ERREXIT( cinfo, JERR_FILE_WRITE );
+		}
+	}
+};
+
 //error handler (looooosely) based on libjpeg example.c:
 
 void throw_error_exit(j_common_ptr cinfo) {
@@ -83,7 +125,78 @@ bool load_jpeg(std::string filename, unsigned int *width_, unsigned int *height_
 	return load_jpeg(in_stream, width_, height_, data_, origin);
 }
 
+//output size, either as a fixed fraction or picked to fit a size:
+struct JpegScale {
+	unsigned int num = 1;
+	unsigned int denom = 1;
+	unsigned int max_dimension = 0; //if non-zero, overrides num / denom (see load_jpeg_max_dimension)
+};
+
+//decode with the data source set up by 'set_source':
+static bool load_jpeg(std::function< void(jpeg_decompress_struct *) > const &set_source, JpegScale const &scale, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin);
+
 bool load_jpeg(std::istream &in_stream, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	std::unique_ptr< stream_source_mgr > src; //(must outlive the decompressor)
+	return load_jpeg([&](jpeg_decompress_struct *cinfo) {
+		src.reset(new stream_source_mgr(cinfo, in_stream));
+	}, JpegScale(), width_, height_, data_, origin);
+}
+
+//read straight out of a buffer:
+static std::function< void(jpeg_decompress_struct *) > memory_source(uint8_t const *from, size_t size) {
+	return [from, size](jpeg_decompress_struct *cinfo) {
+		jpeg_mem_src(cinfo, const_cast< unsigned char * >(from), (unsigned long)size); //(older libjpegs take a non-const pointer)
+		kit::count_bytes_read(size);
+	};
+}
+
+bool load_jpeg(uint8_t const *from, size_t size, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	return load_jpeg(memory_source(from, size), JpegScale(), width_, height_, data_, origin);
+}
+
+bool load_jpeg(std::string filename, unsigned int scale_num, unsigned int scale_denom, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	std::ifstream in_stream(filename, std::ios::binary);
+	return load_jpeg(in_stream, scale_num, scale_denom, width_, height_, data_, origin);
+}
+
+bool load_jpeg(std::istream &in_stream, unsigned int scale_num, unsigned int scale_denom, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	JpegScale scale;
+	scale.num = scale_num;
+	scale.denom = scale_denom;
+	std::unique_ptr< stream_source_mgr > src; //(must outlive the decompressor)
+	return load_jpeg([&](jpeg_decompress_struct *cinfo) {
+		src.reset(new stream_source_mgr(cinfo, in_stream));
+	}, scale, width_, height_, data_, origin);
+}
+
+bool load_jpeg(uint8_t const *from, size_t size, unsigned int scale_num, unsigned int scale_denom, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	JpegScale scale;
+	scale.num = scale_num;
+	scale.denom = scale_denom;
+	return load_jpeg(memory_source(from, size), scale, width_, height_, data_, origin);
+}
+
+bool load_jpeg_max_dimension(std::string filename, unsigned int max_dimension, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	std::ifstream in_stream(filename, std::ios::binary);
+	return load_jpeg_max_dimension(in_stream, max_dimension, width_, height_, data_, origin);
+}
+
+bool load_jpeg_max_dimension(std::istream &in_stream, unsigned int max_dimension, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	JpegScale scale;
+	scale.max_dimension = std::max(1U, max_dimension);
+	std::unique_ptr< stream_source_mgr > src; //(must outlive the decompressor)
+	return load_jpeg([&](jpeg_decompress_struct *cinfo) {
+		src.reset(new stream_source_mgr(cinfo, in_stream));
+	}, scale, width_, height_, data_, origin);
+}
+
+bool load_jpeg_max_dimension(uint8_t const *from, size_t size, unsigned int max_dimension, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
+	JpegScale scale;
+	scale.max_dimension = std::max(1U, max_dimension);
+	return load_jpeg(memory_source(from, size), scale, width_, height_, data_, origin);
+}
+
+static bool load_jpeg(std::function< void(jpeg_decompress_struct *) > const &set_source, JpegScale const &scale, unsigned int *width_, unsigned int *height_, std::vector< uint32_t > *data_, OriginLocation origin) {
 	assert(width_);
 	auto &width = *width_;
 	assert(height_);
@@ -94,6 +207,15 @@ bool load_jpeg(std::istream &in_stream, unsigned int *width_, unsigned int *heig
 	width = 0;
 	height = 0;
 	data.clear();
+
+	//only ratios libjpeg(-turbo) actually supports -- n/8 for n in 1..16, possibly written as 1/2, 3/4, etc:
+	if (!scale.max_dimension) {
+		if (!(scale.denom == 1 || scale.denom == 2 || scale.denom == 4 || scale.denom == 8)
+		 || scale.num == 0 || scale.num > 2 * scale.denom) {
+			std::cout << "Error loading: unsupported jpeg scale " << scale.num << "/" << scale.denom << " (expecting n/8 for n in 1..16)." << std::endl;
+			return false;
+		}
+	}
 	
 	//Based on https://github.com/libjpeg-turbo/libjpeg-turbo/blob/master/libjpeg.txt
 	
@@ -105,14 +227,28 @@ bool load_jpeg(std::istream &in_stream, unsigned int *width_, unsigned int *heig
 	jpeg_create_decompress(&cinfo);
 	
 	try {
-		//set data source to in_stream:
-		stream_source_mgr src(&cinfo, in_stream);
+		//set data source:
+		set_source(&cinfo);
 	
 		//read header:
 		jpeg_read_header(&cinfo, TRUE);
 	
 		//note -- convert colorspace to RGBA:
 		cinfo.out_color_space = JCS_EXT_RGBA;
+
+		//decode at reduced size (libjpeg scales during the IDCT, so this skips most of the work):
+		if (scale.max_dimension) {
+			//smallest of 1/8, 1/4, 1/2, 1 that keeps the larger side at least max_dimension:
+			unsigned int larger = std::max(cinfo.image_width, cinfo.image_height);
+			cinfo.scale_num = 1;
+			cinfo.scale_denom = 8;
+			while (cinfo.scale_denom > 1 && (larger + cinfo.scale_denom - 1) / cinfo.scale_denom < scale.max_dimension) {
+				cinfo.scale_denom /= 2;
+			}
+		} else {
+			cinfo.scale_num = scale.num;
+			cinfo.scale_denom = scale.denom;
+		}
 	
 		//decompression:
 	
@@ -155,4 +291,51 @@ bool load_jpeg(std::istream &in_stream, unsigned int *width_, unsigned int *heig
 	}
 }
 
+void save_jpeg(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, int quality, bool fast_dct) {
+	std::ofstream out_stream(filename, std::ios::binary);
+	save_jpeg(out_stream, width, height, data, origin, quality, fast_dct);
+}
+
+void save_jpeg(std::ostream &out_stream, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, int quality, bool fast_dct) {
+	assert(data || width * height == 0);
+
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
 
+	cinfo.err = jpeg_std_error(&jerr);
+	jerr.error_exit = throw_error_exit;
+	jpeg_create_compress(&cinfo);
+
+	try {
+		stream_destination_mgr dest(&cinfo, out_stream);
+
+		cinfo.image_width = width;
+		cinfo.image_height = height;
+		//note -- take RGBA directly (libjpeg-turbo skips the alpha channel):
+		cinfo.input_components = 4;
+		cinfo.in_color_space = JCS_EXT_RGBA;
+		jpeg_set_defaults(&cinfo);
+		jpeg_set_quality(&cinfo, std::max(0, std::min(100, quality)), TRUE);
+		cinfo.dct_method = (fast_dct ? JDCT_IFAST : JDCT_ISLOW);
+
+		//point at the rows in the order libjpeg wants them (top first), so nothing needs to be flipped:
+		std::vector< JSAMPROW > row_ptrs;
+		row_ptrs.reserve(height);
+		for (uint32_t r = 0; r < height; ++r) {
+			uint32_t row = (origin == LowerLeftOrigin ? height - 1 - r : r);
+			row_ptrs.emplace_back(reinterpret_cast< JSAMPLE * >(const_cast< uint32_t * >(data + size_t(row) * width)));
+		}
+
+		jpeg_start_compress(&cinfo, TRUE);
+		while (cinfo.next_scanline < height) {
+			jpeg_write_scanlines(&cinfo, &row_ptrs[cinfo.next_scanline], height - cinfo.next_scanline);
+		}
+		jpeg_finish_compress(&cinfo);
+
+		jpeg_destroy_compress(&cinfo);
+	} catch (std::exception &e) {
+		jpeg_destroy_compress(&cinfo);
+
+		std::cout << "Error saving: " << e.what() << std::endl;
+	}
+}
@@ -20,10 +20,25 @@ enum OriginLocation {
 
 bool load_jpeg(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin);
 
-//TODO:
-//void save_jpeg(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin);
+//save_jpeg takes RGBA data (as from glReadPixels; alpha is ignored) and passes it to libjpeg without copying,
+// so LowerLeftOrigin data needs no flip. 'quality' is 0-100; 'fast_dct' selects libjpeg's fast (less accurate) DCT.
+void save_jpeg(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, int quality = 90, bool fast_dct = true);
 
 bool load_jpeg(std::istream &from, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
-/*
-void save_jpeg(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin);
-*/
+//decode straight from memory (e.g., a file embedded in a mapped pack):
+bool load_jpeg(uint8_t const *from, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
+
+//decode at scale_num / scale_denom of full size (1/2, 1/4, and 1/8 are fast, since libjpeg skips most of the IDCT work;
+// libjpeg-turbo also allows n/8 for n in 1..16); width and height are set to the scaled size.
+// Other ratios (scale_denom not 1, 2, 4, or 8, or the ratio outside 1/8..2) print an error and return false:
+bool load_jpeg(std::string filename, unsigned int scale_num, unsigned int scale_denom, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin);
+bool load_jpeg(std::istream &from, unsigned int scale_num, unsigned int scale_denom, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
+bool load_jpeg(uint8_t const *from, size_t size, unsigned int scale_num, unsigned int scale_denom, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
+
+//decode at the smallest of 1/8, 1/4, 1/2, or full size whose larger side is still at least 'max_dimension'
+// (e.g., for thumbnails, which can then be shrunk the rest of the way without losing detail):
+bool load_jpeg_max_dimension(std::string filename, unsigned int max_dimension, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin);
+bool load_jpeg_max_dimension(std::istream &from, unsigned int max_dimension, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
+bool load_jpeg_max_dimension(uint8_t const *from, size_t size, unsigned int max_dimension, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
+
+void save_jpeg(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin, int quality = 90, bool fast_dct = true);
@@ -1,4 +1,5 @@
 #include "load_save_png.hpp"
+#include "load_stats.hpp"
 
 #include <png.h>
 
@@ -6,6 +7,7 @@
 #include <fstream>
 #include <cassert>
 #include <vector>
+#include <cstring>
 
 #define LOG_ERROR( X ) std::cerr << X << std::endl
 
@@ -32,6 +34,7 @@ static void user_read_data(png_structp png_ptr, png_bytep data, png_size_t lengt
 	if (!from->read(reinterpret_cast< char * >(data), length)) {
 		png_error(png_ptr, "Error reading.");
 	}
+	kit::count_bytes_read(length);
 }
 
 static void user_write_data(png_structp png_ptr, png_bytep data, png_size_t length) {
@@ -51,7 +54,37 @@ static void user_flush_data(png_structp png_ptr) {
 }
 
 
+//read from a memory region through a cursor (no stream in between):
+struct MemoryReader {
+	uint8_t const *at;
+	uint8_t const *end;
+};
+
+static void memory_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
+	MemoryReader *from = reinterpret_cast< MemoryReader * >(png_get_io_ptr(png_ptr));
+	assert(from);
+	if (size_t(from->end - from->at) < length) {
+		png_error(png_ptr, "Error reading (past end of data).");
+	}
+	std::memcpy(data, from->at, length);
+	from->at += length;
+	kit::count_bytes_read(length);
+}
+
+static bool load_png(png_rw_ptr read_data, void *io, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin);
+
 bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin) {
+	return load_png(user_read_data, &from, width, height, data, origin);
+}
+
+bool load_png(uint8_t const *from, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin) {
+	MemoryReader reader;
+	reader.at = from;
+	reader.end = from + size;
+	return load_png(memory_read_data, &reader, width, height, data, origin);
+}
+
+static bool load_png(png_rw_ptr read_data, void *io, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin) {
 	assert(data);
 	uint32_t local_width, local_height;
 	if (width == nullptr) width = &local_width;
@@ -62,7 +95,7 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 	//Load a png file, as per the libpng docs:
 	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
 
-	png_set_read_fn(png, &from, user_read_data);
+	png_set_read_fn(png, io, read_data);
 
 	if (!png) {
 		LOG_ERROR("  cannot alloc read struct.");
@@ -122,6 +155,94 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 }
 
 
+bool load_png_native(std::string filename, PNGImage *image, OriginLocation origin) {
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_png_native(file, image, origin);
+}
+
+static bool load_png_native(png_rw_ptr read_data, void *io, PNGImage *image, OriginLocation origin);
+
+bool load_png_native(std::istream &from, PNGImage *image, OriginLocation origin) {
+	return load_png_native(user_read_data, &from, image, origin);
+}
+
+bool load_png_native(uint8_t const *from, size_t size, PNGImage *image, OriginLocation origin) {
+	MemoryReader reader;
+	reader.at = from;
+	reader.end = from + size;
+	return load_png_native(memory_read_data, &reader, image, origin);
+}
+
+static bool load_png_native(png_rw_ptr read_data, void *io, PNGImage *image_, OriginLocation origin) {
+	assert(image_);
+	auto &image = *image_;
+	image = PNGImage();
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
+	if (!png) {
+		LOG_ERROR("  cannot alloc read struct.");
+		return false;
+	}
+	png_set_read_fn(png, io, read_data);
+
+	png_infop info = png_create_info_struct(png);
+	if (!info) {
+		LOG_ERROR("  cannot alloc info struct.");
+		png_destroy_read_struct(&png, (png_infopp)NULL, (png_infopp)NULL);
+		return false;
+	}
+	vector< png_bytep > row_pointers;
+	if (setjmp(png_jmpbuf(png))) {
+		LOG_ERROR("  png interal error.");
+		png_destroy_read_struct(&png, &info, (png_infopp)NULL);
+		image = PNGImage();
+		return false;
+	}
+	png_read_info(png, info);
+
+	//only expand what GL can't take directly:
+	png_byte color_type = png_get_color_type(png, info);
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
+	if (color_type == PNG_COLOR_TYPE_GRAY && png_get_bit_depth(png, info) < 8)
+		png_set_expand_gray_1_2_4_to_8(png);
+	if (png_get_valid(png, info, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(png);
+	if (png_get_bit_depth(png, info) == 16) {
+		//png stores 16-bit samples big-endian; GL wants native order:
+		uint16_t probe = 1;
+		if (*reinterpret_cast< uint8_t * >(&probe) == 1) png_set_swap(png);
+	}
+
+	png_read_update_info(png, info);
+	image.width = png_get_image_width(png, info);
+	image.height = png_get_image_height(png, info);
+	image.channels = png_get_channels(png, info);
+	image.bit_depth = png_get_bit_depth(png, info);
+	size_t rowbytes = png_get_rowbytes(png, info);
+	//Make sure it's the format we think it is...
+	assert(rowbytes == image.width * image.pixel_bytes());
+
+	image.data.resize(rowbytes * image.height);
+	row_pointers.resize(image.height);
+	for (unsigned int r = 0; r < image.height; ++r) {
+		if (origin == LowerLeftOrigin) {
+			row_pointers[image.height-1-r] = &image.data[r * rowbytes];
+		} else {
+			row_pointers[r] = &image.data[r * rowbytes];
+		}
+	}
+	png_read_image(png, row_pointers.data());
+	png_destroy_read_struct(&png, &info, NULL);
+
+	return true;
+}
+
+
 void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin) {
 //After the libpng example.c
 	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -20,4 +20,24 @@ bool load_png(std::string filename, unsigned int *width, unsigned int *height, s
 void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin);
 
 bool load_png(std::istream &from, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
+//decode straight from memory (e.g., a file embedded in a mapped pack):
+bool load_png(uint8_t const *from, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
 void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin);
+
+//PNG data in (close to) the file's own format, rather than expanded to 8-bit RGBA:
+// - gray, gray+alpha, rgb, and rgba images keep their channels (transparency chunks become an alpha channel);
+// - palette images become rgb (or rgba, if they have transparency);
+// - samples are 8 bits (1, 2, and 4 bit samples are expanded) or 16 bits (in native byte order).
+struct PNGImage {
+	unsigned int width = 0;
+	unsigned int height = 0;
+	uint32_t channels = 0; //1 (gray), 2 (gray+alpha), 3 (rgb), 4 (rgba)
+	uint32_t bit_depth = 0; //8 or 16
+	std::vector< uint8_t > data; //rows are tightly packed (no padding)
+
+	size_t pixel_bytes() const { return channels * (bit_depth / 8); }
+};
+
+bool load_png_native(std::string filename, PNGImage *image, OriginLocation origin);
+bool load_png_native(std::istream &from, PNGImage *image, OriginLocation origin = UpperLeftOrigin);
+bool load_png_native(uint8_t const *from, size_t size, PNGImage *image, OriginLocation origin = UpperLeftOrigin);
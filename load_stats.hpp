@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * Per-thread counters of bytes read from files and bytes uploaded to the GPU.
+ *
+ * Loading code (ChunkFile, read_chunk, load_png, load_jpeg, GLBuffer, GLTexture, ...)
+ *  calls count_bytes_read / count_gpu_bytes; call_load_functions() samples the
+ *  counters around each Load< > phase to build its report (see Load.hpp).
+ *
+ * Counts are per-thread, so work a loader hands off to other threads
+ *  (e.g., via ThreadPool::parallel_for) is only counted if it calls these functions
+ *  on the loader's thread.
+ *
+ * data_path() also notes the files each load uses (with note_load_file), which is
+ *  how hot reload knows which loads to re-run when a file changes.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace kit {
+
+struct LoadCounters {
+	uint64_t bytes_read = 0; //file data read (compressed size where that is known)
+	uint64_t gpu_bytes = 0; //data passed to glBufferData / glTexImage*
+};
+
+inline LoadCounters &load_counters() {
+	static thread_local LoadCounters counters;
+	return counters;
+}
+
+inline void count_bytes_read(uint64_t bytes) {
+	load_counters().bytes_read += bytes;
+}
+
+inline void count_gpu_bytes(uint64_t bytes) {
+	load_counters().gpu_bytes += bytes;
+}
+
+//where this thread's note_load_file calls are recorded (nullptr if not inside a load):
+inline std::vector< std::string > *&load_files() {
+	static thread_local std::vector< std::string > *files = nullptr;
+	return files;
+}
+
+inline void note_load_file(std::string const &path) {
+	if (auto files = load_files()) files->emplace_back(path);
+}
+
+}
@@ -0,0 +1,410 @@
+#include "mesh_optimize.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+namespace kit {
+
+void weld_vertices(void const *vertices_, size_t stride, uint32_t begin, uint32_t end, std::vector< uint8_t > *out_vertices_, std::vector< uint32_t > *out_indices_) {
+	assert(vertices_);
+	uint8_t const *vertices = reinterpret_cast< uint8_t const * >(vertices_);
+	assert(out_vertices_);
+	auto &out_vertices = *out_vertices_;
+	assert(out_indices_);
+	auto &out_indices = *out_indices_;
+	assert(out_vertices.size() % stride == 0);
+	assert(begin <= end);
+
+	auto hash = [stride](uint8_t const *v) {
+		uint64_t h = 0xcbf29ce484222325ULL; //FNV-1a
+		for (size_t i = 0; i < stride; ++i) {
+			h = (h ^ v[i]) * 0x100000001b3ULL;
+		}
+		return h;
+	};
+
+	//open-addressed table of (welded vertex index + 1), zero for empty:
+	size_t slots = 16;
+	while (slots < 2 * size_t(end - begin)) slots *= 2;
+	std::vector< uint32_t > table(slots, 0);
+
+	uint32_t first = uint32_t(out_vertices.size() / stride);
+	out_vertices.reserve(out_vertices.size() + (end - begin) * stride);
+	out_indices.reserve(out_indices.size() + (end - begin));
+	for (uint32_t i = begin; i < end; ++i) {
+		uint8_t const *v = vertices + i * stride;
+		size_t slot = size_t(hash(v)) & (slots - 1);
+		while (true) {
+			if (table[slot] == 0) {
+				out_vertices.insert(out_vertices.end(), v, v + stride);
+				uint32_t index = uint32_t(out_vertices.size() / stride) - 1;
+				table[slot] = index - first + 1;
+				out_indices.emplace_back(index);
+				break;
+			}
+			uint32_t existing = first + table[slot] - 1;
+			if (std::memcmp(out_vertices.data() + existing * stride, v, stride) == 0) {
+				out_indices.emplace_back(existing);
+				break;
+			}
+			slot = (slot + 1) & (slots - 1);
+		}
+	}
+}
+
+//------------------------------------------------
+//vertex cache optimization, following:
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+
+namespace {
+	constexpr uint32_t CacheSize = 32; //size of the modelled cache
+	constexpr uint32_t MaxValence = 32; //valence scores are tabulated up to this
+
+	struct ScoreTables {
+		float cache[CacheSize];
+		float valence[MaxValence];
+		ScoreTables() {
+			for (uint32_t i = 0; i < CacheSize; ++i) {
+				if (i < 3) {
+					//vertices from the last triangle get a fixed score, so as not to favor any particular winding:
+					cache[i] = 0.75f;
+				} else {
+					cache[i] = std::pow(1.0f - float(i - 3) / float(CacheSize - 3), 1.5f);
+				}
+			}
+			valence[0] = 0.0f;
+			for (uint32_t i = 1; i < MaxValence; ++i) {
+				//boost vertices with few triangles left, to avoid leaving lone triangles behind:
+				valence[i] = 2.0f * std::pow(float(i), -0.5f);
+			}
+		}
+	};
+
+	float vertex_score(ScoreTables const &tables, int32_t cache_position, uint32_t remaining) {
+		if (remaining == 0) return -1.0f; //no triangles left; score doesn't matter
+		float score = (cache_position >= 0 ? tables.cache[cache_position] : 0.0f);
+		score += (remaining < MaxValence ? tables.valence[remaining] : 2.0f * std::pow(float(remaining), -0.5f));
+		return score;
+	}
+}
+
+void optimize_vertex_cache(uint32_t *indices, size_t index_count, uint32_t vertex_count) {
+	assert(index_count % 3 == 0);
+	size_t triangle_count = index_count / 3;
+	if (triangle_count == 0) return;
+
+	static ScoreTables const tables;
+
+	//adjacency (triangles using each vertex), stored compactly:
+	std::vector< uint32_t > remaining(vertex_count, 0);
+	for (size_t i = 0; i < index_count; ++i) {
+		if (indices[i] >= vertex_count) throw std::runtime_error("index out of range");
+		remaining[indices[i]] += 1;
+	}
+	std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		adjacency_begin[v+1] = adjacency_begin[v] + remaining[v];
+	}
+	std::vector< uint32_t > adjacency(index_count);
+	{
+		std::vector< uint32_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (size_t i = 0; i < index_count; ++i) {
+			adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+		}
+	}
+
+	std::vector< int32_t > cache_position(vertex_count, -1);
+	std::vector< float > score(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		score[v] = vertex_score(tables, -1, remaining[v]);
+	}
+
+	std::vector< float > triangle_score(triangle_count);
+	std::vector< bool > emitted(triangle_count, false);
+	for (size_t t = 0; t < triangle_count; ++t) {
+		triangle_score[t] = score[indices[3*t+0]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+	}
+
+	std::vector< uint32_t > output;
+	output.reserve(index_count);
+
+	std::vector< uint32_t > cache;
+	std::vector< uint32_t > new_cache;
+	cache.reserve(CacheSize + 3);
+	new_cache.reserve(CacheSize + 3);
+
+	size_t best = std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin();
+	size_t scan = 0; //all triangles before this have been emitted
+
+	for (size_t emit = 0; emit < triangle_count; ++emit) {
+		if (best == triangle_count) {
+			//dead end -- nothing adjacent to the cache, so pick any remaining triangle:
+			while (emitted[scan]) ++scan;
+			best = scan;
+		}
+
+		uint32_t const *tri = indices + 3 * best;
+		output.insert(output.end(), tri, tri + 3);
+		emitted[best] = true;
+
+		//remove triangle from its vertices' adjacency lists:
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = tri[k];
+			uint32_t *list = adjacency.data() + adjacency_begin[v];
+			uint32_t *list_end = list + remaining[v];
+			uint32_t *found = std::find(list, list_end, uint32_t(best));
+			assert(found != list_end);
+			std::swap(*found, *(list_end - 1));
+			remaining[v] -= 1;
+		}
+
+		//move triangle's vertices to the front of the cache:
+		new_cache.clear();
+		new_cache.insert(new_cache.end(), tri, tri + 3);
+		for (uint32_t v : cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2]) new_cache.emplace_back(v);
+		}
+		for (uint32_t i = CacheSize; i < new_cache.size(); ++i) {
+			cache_position[new_cache[i]] = -1; //fell out of the cache
+		}
+
+		//update scores of vertices that were (or are now) in the cache, and of their triangles:
+		auto update = [&](uint32_t v) {
+			float new_score = vertex_score(tables, cache_position[v], remaining[v]);
+			float delta = new_score - score[v];
+			score[v] = new_score;
+			uint32_t const *list = adjacency.data() + adjacency_begin[v];
+			for (uint32_t i = 0; i < remaining[v]; ++i) {
+				triangle_score[list[i]] += delta;
+			}
+		};
+		for (uint32_t i = 0; i < new_cache.size(); ++i) {
+			if (i < CacheSize) cache_position[new_cache[i]] = int32_t(i);
+			update(new_cache[i]);
+		}
+		if (new_cache.size() > CacheSize) new_cache.resize(CacheSize);
+		std::swap(cache, new_cache);
+
+		//next triangle is the best-scoring one touching the cache:
+		best = triangle_count;
+		float best_score = -1.0f;
+		for (uint32_t v : cache) {
+			uint32_t const *list = adjacency.data() + adjacency_begin[v];
+			for (uint32_t i = 0; i < remaining[v]; ++i) {
+				if (triangle_score[list[i]] > best_score) {
+					best_score = triangle_score[list[i]];
+					best = list[i];
+				}
+			}
+		}
+	}
+
+	assert(output.size() == index_count);
+	std::copy(output.begin(), output.end(), indices);
+}
+
+//------------------------------------------------
+//overdraw optimization:
+
+void optimize_overdraw(uint32_t *indices, size_t index_count, void const *positions_, size_t stride, uint32_t vertex_count, float threshold) {
+	assert(index_count % 3 == 0);
+	size_t triangle_count = index_count / 3;
+	if (triangle_count < 2) return;
+	uint8_t const *positions = reinterpret_cast< uint8_t const * >(positions_);
+
+	auto position = [&](uint32_t v) {
+		glm::vec3 p;
+		std::memcpy(&p, positions + v * stride, sizeof(p));
+		return p;
+	};
+
+	//clusters are runs of triangles that can be moved around without hurting cache use much:
+	std::vector< size_t > cluster_begin;
+	{
+		//"hard" boundaries are triangles where the cache misses every vertex:
+		std::vector< size_t > hard;
+		std::vector< uint32_t > inserted(vertex_count, 0);
+		uint32_t time = 16 + 1; //(so zero-initialized entries are all outside the cache)
+		for (size_t t = 0; t < triangle_count; ++t) {
+			uint32_t misses = 0;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t v = indices[3*t+k];
+				if (time - inserted[v] > 16) {
+					inserted[v] = time++;
+					misses += 1;
+				}
+			}
+			if (misses == 3) hard.emplace_back(t);
+		}
+		if (hard.empty() || hard[0] != 0) hard.insert(hard.begin(), 0);
+		hard.emplace_back(triangle_count);
+
+		//"soft" boundaries split hard clusters at points where the cache has warmed up:
+		// (one timestamp array serves every cluster; advancing local_time past the cache size flushes it)
+		std::vector< uint32_t > local(vertex_count, 0);
+		uint32_t local_time = 16 + 1;
+		for (size_t h = 0; h + 1 < hard.size(); ++h) {
+			size_t begin = hard[h];
+			size_t end = hard[h+1];
+
+			//cluster's own ACMR, starting from an empty cache:
+			local_time += 16 + 1;
+			uint32_t cluster_misses = 0;
+			for (size_t t = begin; t < end; ++t) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t v = indices[3*t+k];
+					if (local_time - local[v] > 16) {
+						local[v] = local_time++;
+						cluster_misses += 1;
+					}
+				}
+			}
+			float cluster_acmr = float(cluster_misses) / float(end - begin);
+
+			cluster_begin.emplace_back(begin);
+			local_time += 16 + 1;
+			uint32_t misses = 0;
+			size_t start = begin;
+			for (size_t t = begin; t < end; ++t) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t v = indices[3*t+k];
+					if (local_time - local[v] > 16) {
+						local[v] = local_time++;
+						misses += 1;
+					}
+				}
+				size_t tris = t + 1 - start;
+				if (tris >= 16 && t + 1 < end && float(misses) / float(tris) <= cluster_acmr * threshold) {
+					cluster_begin.emplace_back(t + 1);
+					start = t + 1;
+					misses = 0;
+					local_time += 16 + 1; //(flushes the cache)
+				}
+			}
+		}
+		cluster_begin.emplace_back(triangle_count);
+	}
+	size_t cluster_count = cluster_begin.size() - 1;
+	if (cluster_count < 2) return;
+
+	//sort clusters by how much they face away from the center of the mesh:
+	glm::vec3 mesh_center = glm::vec3(0.0f);
+	float mesh_area = 0.0f;
+	std::vector< glm::vec3 > cluster_center(cluster_count);
+	std::vector< glm::vec3 > cluster_normal(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) {
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float area = 0.0f;
+		for (size_t t = cluster_begin[c]; t < cluster_begin[c+1]; ++t) {
+			glm::vec3 a = position(indices[3*t+0]);
+			glm::vec3 b = position(indices[3*t+1]);
+			glm::vec3 d = position(indices[3*t+2]);
+			glm::vec3 n = glm::cross(b - a, d - a); //length is twice triangle area
+			float tri_area = glm::length(n);
+			center += (a + b + d) * (tri_area / 3.0f);
+			normal += n;
+			area += tri_area;
+		}
+		mesh_center += center;
+		mesh_area += area;
+		cluster_center[c] = (area > 0.0f ? center / area : center);
+		cluster_normal[c] = normal;
+	}
+	if (mesh_area > 0.0f) mesh_center /= mesh_area;
+
+	std::vector< float > key(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) {
+		float len = glm::length(cluster_normal[c]);
+		key[c] = (len > 0.0f ? glm::dot(cluster_center[c] - mesh_center, cluster_normal[c] / len) : 0.0f);
+	}
+	std::vector< size_t > order(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&key](size_t a, size_t b) {
+		return key[a] > key[b];
+	});
+
+	std::vector< uint32_t > output;
+	output.reserve(index_count);
+	for (size_t c : order) {
+		output.insert(output.end(), indices + 3 * cluster_begin[c], indices + 3 * cluster_begin[c+1]);
+	}
+
+	//only keep the new order if it doesn't cost too much vertex cache performance:
+	float before = compute_acmr(indices, index_count, vertex_count);
+	float after = compute_acmr(output.data(), output.size(), vertex_count);
+	if (after <= before * threshold) {
+		std::copy(output.begin(), output.end(), indices);
+	}
+}
+
+//------------------------------------------------
+//vertex fetch optimization:
+
+std::vector< uint32_t > vertex_fetch_remap(uint32_t const *indices, size_t index_count, uint32_t vertex_count) {
+	std::vector< uint32_t > remap(vertex_count, -1U);
+	uint32_t next = 0;
+	for (size_t i = 0; i < index_count; ++i) {
+		uint32_t v = indices[i];
+		if (v >= vertex_count) throw std::runtime_error("index out of range");
+		if (remap[v] == -1U) remap[v] = next++;
+	}
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		if (remap[v] == -1U) remap[v] = next++;
+	}
+	assert(next == vertex_count);
+	return remap;
+}
+
+void optimize_vertex_fetch(uint32_t *indices, size_t index_count, void *vertices_, size_t stride, uint32_t vertex_count) {
+	uint8_t *vertices = reinterpret_cast< uint8_t * >(vertices_);
+	std::vector< uint32_t > remap = vertex_fetch_remap(indices, index_count, vertex_count);
+
+	std::vector< uint8_t > reordered(size_t(vertex_count) * stride);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		std::memcpy(reordered.data() + remap[v] * stride, vertices + v * stride, stride);
+	}
+	std::memcpy(vertices, reordered.data(), reordered.size());
+
+	for (size_t i = 0; i < index_count; ++i) {
+		indices[i] = remap[indices[i]];
+	}
+}
+
+//------------------------------------------------
+//statistics:
+
+namespace {
+	//number of vertices transformed when drawing with a FIFO cache:
+	size_t count_transforms(uint32_t const *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+		std::vector< uint32_t > inserted(vertex_count, 0);
+		uint32_t time = cache_size + 1; //(so zero-initialized entries are all outside the cache)
+		size_t transforms = 0;
+		for (size_t i = 0; i < index_count; ++i) {
+			uint32_t v = indices[i];
+			if (v >= vertex_count) throw std::runtime_error("index out of range");
+			if (time - inserted[v] > cache_size) {
+				inserted[v] = time++;
+				transforms += 1;
+			}
+		}
+		return transforms;
+	}
+}
+
+float compute_acmr(uint32_t const *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+	if (index_count < 3) return 0.0f;
+	return float(count_transforms(indices, index_count, vertex_count, cache_size)) / float(index_count / 3);
+}
+
+float compute_atvr(uint32_t const *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+	if (vertex_count == 0) return 0.0f;
+	return float(count_transforms(indices, index_count, vertex_count, cache_size)) / float(vertex_count);
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * Helpers for preparing indexed triangle meshes for the GPU.
+ *
+ * These work on raw vertex bytes (with a given stride), so they can be used
+ *  both by MeshBuffer at load time and by offline tools (see export/optimize-meshes.cpp).
+ *
+ * A typical pipeline is:
+ *   weld_vertices -> optimize_vertex_cache -> optimize_overdraw -> optimize_vertex_fetch
+ *
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace kit {
+
+//merge byte-identical vertices in vertices[begin,end) (indices are in units of vertices, not bytes):
+// appends the unique vertices to 'out_vertices' and one index per input vertex to 'out_indices'
+void weld_vertices(void const *vertices, size_t stride, uint32_t begin, uint32_t end, std::vector< uint8_t > *out_vertices, std::vector< uint32_t > *out_indices);
+
+//reorder triangles to make good use of the post-transform vertex cache
+// (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"):
+void optimize_vertex_cache(uint32_t *indices, size_t index_count, uint32_t vertex_count);
+
+//reorder clusters of triangles so that outward-facing clusters tend to be drawn first, reducing overdraw
+// (the cluster ordering pass from Sander et al.'s "Tipsify"); call after optimize_vertex_cache.
+// 'positions' points to the first vertex's position (three floats); positions are 'stride' bytes apart.
+// Keeps the new order only if it raises ACMR by no more than a factor of 'threshold'.
+void optimize_overdraw(uint32_t *indices, size_t index_count, void const *positions, size_t stride, uint32_t vertex_count, float threshold = 1.05f);
+
+//compute a vertex order that matches the order in which indices first reference vertices:
+// returns remap[old index] = new index (unreferenced vertices go at the end, in their old order)
+std::vector< uint32_t > vertex_fetch_remap(uint32_t const *indices, size_t index_count, uint32_t vertex_count);
+
+//reorder vertices (in place) to match the order in which they are used, and rewrite indices to match:
+void optimize_vertex_fetch(uint32_t *indices, size_t index_count, void *vertices, size_t stride, uint32_t vertex_count);
+
+//average cache miss ratio (transformed vertices per triangle) with a FIFO cache of the given size:
+float compute_acmr(uint32_t const *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size = 16);
+//average transform to vertex ratio (transformed vertices per vertex; 1.0 is ideal):
+float compute_atvr(uint32_t const *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size = 16);
+
+}
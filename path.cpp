@@ -1,4 +1,5 @@
 #include "path.hpp"
+#include "load_stats.hpp"
 
 #include <iostream>
 #include <vector>
@@ -60,7 +61,9 @@ static std::string get_data_path() {
 
 std::string kit::data_path(std::string const &suffix) {
 	static std::string path = get_data_path();
-	return path + "/" + kit::data_path_subdir + suffix;
+	std::string ret = path + "/" + kit::data_path_subdir + suffix;
+	kit::note_load_file(ret); //(so hot reload can watch it)
+	return ret;
 }
 
 /* From Rktcr; to be used eventually!
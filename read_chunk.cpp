@@ -0,0 +1,163 @@
+#include "read_chunk.hpp"
+#include "ThreadPool.hpp"
+
+#include <zlib.h>
+
+#include <memory>
+
+namespace {
+	struct DeflatedBlocks {
+		uint32_t block_size = 0;
+		uint32_t block_count = 0;
+	};
+	static_assert(sizeof(DeflatedBlocks) == 8, "block header is packed");
+
+	//check that a block table is consistent with a chunk's decompressed and stored sizes:
+	void check_blocks(DeflatedBlocks const &blocks, uint32_t const *block_stored, uint64_t stored, uint64_t size) {
+		if (blocks.block_size == 0 && size != 0) {
+			throw std::runtime_error("Compressed chunk has zero block size");
+		}
+		if (blocks.block_size != 0 && uint64_t(blocks.block_count) != (size + blocks.block_size - 1) / blocks.block_size) {
+			throw std::runtime_error("Compressed chunk has wrong block count");
+		}
+		uint64_t total = sizeof(DeflatedBlocks) + uint64_t(blocks.block_count) * sizeof(uint32_t);
+		for (uint32_t b = 0; b < blocks.block_count; ++b) {
+			total += block_stored[b];
+		}
+		if (total != stored) {
+			throw std::runtime_error("Compressed chunk block sizes don't match stored size");
+		}
+	}
+
+	void inflate_block(char const *from, uint32_t from_size, char *to, uint32_t to_size) {
+		uLongf got = to_size;
+		int ret = uncompress(reinterpret_cast< Bytef * >(to), &got, reinterpret_cast< Bytef const * >(from), from_size);
+		if (ret != Z_OK || got != to_size) {
+			throw std::runtime_error("Failed to decompress chunk block (zlib error " + std::to_string(ret) + ")");
+		}
+	}
+}
+
+void inflate_chunk_blocks(char const *stored_data, uint64_t stored, char *to, uint64_t size) {
+	DeflatedBlocks blocks;
+	if (stored < sizeof(blocks)) {
+		throw std::runtime_error("Compressed chunk is missing block table");
+	}
+	std::memcpy(&blocks, stored_data, sizeof(blocks));
+	if (stored - sizeof(blocks) < uint64_t(blocks.block_count) * sizeof(uint32_t)) {
+		throw std::runtime_error("Compressed chunk is missing block table");
+	}
+	std::vector< uint32_t > block_stored(blocks.block_count);
+	if (blocks.block_count) {
+		std::memcpy(block_stored.data(), stored_data + sizeof(blocks), blocks.block_count * sizeof(uint32_t));
+	}
+	check_blocks(blocks, block_stored.data(), stored, size);
+
+	//starting offset of each block's compressed data:
+	std::vector< uint64_t > block_begin(blocks.block_count);
+	uint64_t at = sizeof(blocks) + uint64_t(blocks.block_count) * sizeof(uint32_t);
+	for (uint32_t b = 0; b < blocks.block_count; ++b) {
+		block_begin[b] = at;
+		at += block_stored[b];
+	}
+
+	kit::thread_pool().parallel_for(blocks.block_count, [&](size_t b) {
+		uint64_t begin = uint64_t(b) * blocks.block_size;
+		uint32_t block_size = uint32_t(std::min< uint64_t >(blocks.block_size, size - begin));
+		inflate_block(stored_data + block_begin[b], block_stored[b], to + begin, block_size);
+	});
+}
+
+void read_deflated_chunk_data(std::istream &from, char *to, uint64_t size) {
+	uint64_t stored = 0;
+	if (!from.read(reinterpret_cast< char * >(&stored), sizeof(stored))) {
+		throw std::runtime_error("Failed to read compressed chunk header");
+	}
+	//compressed data is read in one go, then blocks are decompressed in parallel:
+	std::vector< char > stored_data(static_cast< size_t >(stored));
+	if (!from.read(stored_data.data(), stored_data.size())) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	inflate_chunk_blocks(stored_data.data(), stored, to, size);
+}
+
+void read_deflated_chunk_blocks(std::istream &from, uint64_t size, std::function< void(char const *, size_t) > const &callback) {
+	uint64_t stored = 0;
+	DeflatedBlocks blocks;
+	if (!from.read(reinterpret_cast< char * >(&stored), sizeof(stored))
+	 || !from.read(reinterpret_cast< char * >(&blocks), sizeof(blocks))) {
+		throw std::runtime_error("Failed to read compressed chunk header");
+	}
+	std::vector< uint32_t > block_stored(blocks.block_count);
+	if (!from.read(reinterpret_cast< char * >(block_stored.data()), block_stored.size() * sizeof(uint32_t))) {
+		throw std::runtime_error("Failed to read compressed chunk header");
+	}
+	check_blocks(blocks, block_stored.data(), stored, size);
+
+	//blocks are decompressed one at a time, to keep memory use bounded:
+	std::vector< char > compressed;
+	std::vector< char > block;
+	for (uint32_t b = 0; b < blocks.block_count; ++b) {
+		compressed.resize(block_stored[b]);
+		if (!from.read(compressed.data(), compressed.size())) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+		uint64_t begin = uint64_t(b) * blocks.block_size;
+		block.resize(size_t(std::min< uint64_t >(blocks.block_size, size - begin)));
+		inflate_block(compressed.data(), block_stored[b], block.data(), uint32_t(block.size()));
+		callback(block.data(), block.size());
+	}
+}
+
+void write_deflated_chunk(std::string const &magic, char const *from, uint64_t size, std::ostream *to_, uint32_t block_size) {
+	assert(magic.size() == 4);
+	assert(to_);
+	auto &to = *to_;
+	assert(block_size > 0);
+
+	DeflatedBlocks blocks;
+	blocks.block_size = block_size;
+	blocks.block_count = uint32_t((size + block_size - 1) / block_size);
+
+	//compress blocks in parallel:
+	std::vector< std::vector< char > > compressed(blocks.block_count);
+	kit::thread_pool().parallel_for(blocks.block_count, [&](size_t b) {
+		uint64_t begin = uint64_t(b) * block_size;
+		uLong source_size = uLong(std::min< uint64_t >(block_size, size - begin));
+		uLongf dest_size = compressBound(source_size);
+		compressed[b].resize(dest_size);
+		int ret = compress2(reinterpret_cast< Bytef * >(compressed[b].data()), &dest_size, reinterpret_cast< Bytef const * >(from + begin), source_size, Z_BEST_COMPRESSION);
+		if (ret != Z_OK) {
+			throw std::runtime_error("Failed to compress chunk block (zlib error " + std::to_string(ret) + ")");
+		}
+		compressed[b].resize(dest_size);
+	});
+
+	std::vector< uint32_t > block_stored;
+	block_stored.reserve(blocks.block_count);
+	uint64_t stored = sizeof(blocks) + uint64_t(blocks.block_count) * sizeof(uint32_t);
+	for (auto const &c : compressed) {
+		block_stored.emplace_back(uint32_t(c.size()));
+		stored += c.size();
+	}
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = ChunkSizeDeflated;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+	ChunkHeader header;
+	header.magic[0] = magic[0];
+	header.magic[1] = magic[1];
+	header.magic[2] = magic[2];
+	header.magic[3] = magic[3];
+
+	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	to.write(reinterpret_cast< const char * >(&size), sizeof(size));
+	to.write(reinterpret_cast< const char * >(&stored), sizeof(stored));
+	to.write(reinterpret_cast< const char * >(&blocks), sizeof(blocks));
+	to.write(reinterpret_cast< const char * >(block_stored.data()), block_stored.size() * sizeof(uint32_t));
+	for (auto const &c : compressed) {
+		to.write(c.data(), c.size());
+	}
+}
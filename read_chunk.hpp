@@ -1,15 +1,74 @@
 #pragma once
 
+#include "load_stats.hpp"
+
 #include <iostream>
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
 
-template< typename T >
-void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
-	assert(to_);
-	auto &to = *to_;
+//A chunk file may optionally end with a table of contents, to allow random access to its chunks:
+// "toc0" chunk: array of ChunkTOCEntry, one per chunk, in file order
+// "tocp" struct chunk: uint64_t offset of the "toc0" chunk's header
+//Since "tocp" is always the final 16 bytes of the file, readers can find it by seeking from the end.
+//
+//To write a table of contents, pass a toc vector to write_chunk / write_struct, then call write_toc:
+//  std::vector< ChunkTOCEntry > toc;
+//  write_chunk("pnct", data, &file, &toc);
+//  write_chunk("str0", strings, &file, &toc);
+//  write_toc(toc, &file);
+
+struct ChunkTOCEntry {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t reserved = 0; //(keeps offset aligned)
+	uint64_t offset = 0; //offset of chunk header from start of file
 
+	ChunkTOCEntry() = default;
+	ChunkTOCEntry(std::string const &magic_, uint64_t offset_) : offset(offset_) {
+		assert(magic_.size() == 4);
+		std::memcpy(magic, magic_.data(), 4);
+	}
+};
+static_assert(sizeof(ChunkTOCEntry) == 16, "toc entry is packed");
+
+//Chunk headers are normally eight bytes: a four-character magic number followed by a uint32_t size.
+//Chunks too large for that (4 GiB or more) use a "wide" header, in which the 32-bit size holds
+// ChunkSizeWide and is followed by the real size as a uint64_t.
+//(So older readers will reject wide chunks rather than misreading them.)
+//
+//Chunks written with write_deflated_chunk are compressed; their 32-bit size holds ChunkSizeDeflated,
+// and is followed by:
+//  uint64_t size; //decompressed size
+//  uint64_t stored; //size of everything below
+//  uint32_t block_size; //decompressed size of each block (the last block may be shorter)
+//  uint32_t block_count;
+//  uint32_t block_stored[block_count]; //compressed size of each block
+//  ...blocks, each compressed independently with zlib...
+//Readers decompress these chunks transparently, spreading blocks over kit::thread_pool().
+//(Compressed chunk support lives in read_chunk.cpp, which links against zlib.)
+enum : uint32_t {
+	ChunkSizeWide = 0xffffffff,
+	ChunkSizeDeflated = 0xfffffffe,
+};
+
+//read the rest of a compressed chunk (after its decompressed size) into 'to':
+void read_deflated_chunk_data(std::istream &from, char *to, uint64_t size);
+//read the rest of a compressed chunk (after its decompressed size), passing each decompressed block to callback:
+void read_deflated_chunk_blocks(std::istream &from, uint64_t size, std::function< void(char const *, size_t) > const &callback);
+//decompress blocks from the 'stored' part of a compressed chunk in memory:
+void inflate_chunk_blocks(char const *stored_data, uint64_t stored, char *to, uint64_t size);
+//write a compressed chunk; block_size is the decompressed size of each independently compressed block:
+void write_deflated_chunk(std::string const &magic, char const *from, uint64_t size, std::ostream *to, uint32_t block_size);
+
+//read a chunk header, check its magic number, and return the size of its data:
+// if deflated is passed, sets *deflated to indicate a compressed chunk, in which case the
+// returned size is the decompressed size and the stream is positioned at the compressed data.
+// (if deflated is not passed, compressed chunks are an error)
+inline uint64_t read_chunk_header(std::istream &from, std::string const &magic, bool *deflated = nullptr) {
 	struct ChunkHeader {
 		char magic[4] = {'\0', '\0', '\0', '\0'};
 		uint32_t size = 0;
@@ -24,18 +83,21 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Unexpected magic number in chunk");
 	}
 
-	if (header.size % sizeof(T) != 0) {
-		throw std::runtime_error("Size of chunk not divisible by element size");
+	if (deflated) *deflated = (header.size == ChunkSizeDeflated);
+	if (header.size == ChunkSizeDeflated && !deflated) {
+		throw std::runtime_error("Unexpected compressed chunk");
 	}
+	if (header.size != ChunkSizeWide && header.size != ChunkSizeDeflated) return header.size;
 
-	to.resize(header.size / sizeof(T));
-	if (!from.read(reinterpret_cast< char * >(&to[0]), to.size() * sizeof(T))) {
-		throw std::runtime_error("Failed to read chunk data.");
+	uint64_t size = 0;
+	if (!from.read(reinterpret_cast< char * >(&size), sizeof(size))) {
+		throw std::runtime_error("Failed to read wide chunk header");
 	}
+	return size;
 }
 
-template< typename T >
-void read_struct(std::istream &from, std::string const &magic, T *to_) {
+inline void write_chunk_header(std::string const &magic, uint64_t size, std::ostream *to_) {
+	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
 
@@ -44,65 +106,193 @@ void read_struct(std::istream &from, std::string const &magic, T *to_) {
 		uint32_t size = 0;
 	};
 	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-
 	ChunkHeader header;
-	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
-		throw std::runtime_error("Failed to read chunk header");
+	header.magic[0] = magic[0];
+	header.magic[1] = magic[1];
+	header.magic[2] = magic[2];
+	header.magic[3] = magic[3];
+	header.size = (size < ChunkSizeDeflated ? uint32_t(size) : ChunkSizeWide);
+
+	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	if (header.size == ChunkSizeWide) {
+		to.write(reinterpret_cast< const char * >(&size), sizeof(size));
 	}
-	if (std::string(header.magic,4) != magic) {
-		throw std::runtime_error("Unexpected magic number in chunk");
+}
+
+template< typename T >
+void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
+	assert(to_);
+	auto &to = *to_;
+
+	bool deflated = false;
+	uint64_t size = read_chunk_header(from, magic, &deflated);
+
+	if (size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	kit::count_bytes_read(size);
+	to.resize(size / sizeof(T));
+	if (deflated) {
+		read_deflated_chunk_data(from, reinterpret_cast< char * >(to.data()), size);
+	} else if (!from.read(reinterpret_cast< char * >(to.data()), to.size() * sizeof(T))) {
+		throw std::runtime_error("Failed to read chunk data.");
 	}
+}
 
-	if (header.size != sizeof(T)) {
+//read a chunk in pieces of (at most) piece_count elements, passing each to callback(T const *data, size_t count):
+// useful for very large chunks, since it never holds more than one piece in memory.
+// (compressed chunks are passed along one block at a time, regardless of piece_count)
+template< typename T, typename Callback >
+void read_chunk_pieces(std::istream &from, std::string const &magic, size_t piece_count, Callback const &callback) {
+	assert(piece_count > 0);
+
+	bool deflated = false;
+	uint64_t size = read_chunk_header(from, magic, &deflated);
+
+	if (size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	kit::count_bytes_read(size);
+	if (deflated) {
+		std::vector< T > piece;
+		read_deflated_chunk_blocks(from, size, [&](char const *data, size_t bytes) {
+			if (bytes % sizeof(T) != 0) {
+				throw std::runtime_error("Size of compressed block not divisible by element size");
+			}
+			piece.resize(bytes / sizeof(T));
+			std::memcpy(piece.data(), data, bytes);
+			callback(static_cast< T const * >(piece.data()), piece.size());
+		});
+		return;
+	}
+
+	uint64_t remaining = size / sizeof(T);
+	std::vector< T > piece(size_t(std::min< uint64_t >(piece_count, remaining)));
+	while (remaining > 0) {
+		size_t count = size_t(std::min< uint64_t >(piece.size(), remaining));
+		if (!from.read(reinterpret_cast< char * >(piece.data()), count * sizeof(T))) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+		callback(static_cast< T const * >(piece.data()), count);
+		remaining -= count;
+	}
+}
+
+template< typename T >
+void read_struct(std::istream &from, std::string const &magic, T *to_) {
+	assert(to_);
+	auto &to = *to_;
+
+	bool deflated = false;
+	uint64_t size = read_chunk_header(from, magic, &deflated);
+
+	if (size != sizeof(T)) {
 		throw std::runtime_error("Size of chunk not struct size");
 	}
 
-	if (!from.read(reinterpret_cast< char * >(&to), sizeof(T))) {
+	kit::count_bytes_read(size);
+	if (deflated) {
+		read_deflated_chunk_data(from, reinterpret_cast< char * >(&to), sizeof(T));
+	} else if (!from.read(reinterpret_cast< char * >(&to), sizeof(T))) {
 		throw std::runtime_error("Failed to read struct chunk data.");
 	}
 }
 
 template< typename T >
-void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
+void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_, std::vector< ChunkTOCEntry > *toc = nullptr) {
 	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-	ChunkHeader header;
-	header.magic[0] = magic[0];
-	header.magic[1] = magic[1];
-	header.magic[2] = magic[2];
-	header.magic[3] = magic[3];
-	header.size = from.size() * sizeof(T);
+	if (toc) toc->emplace_back(magic, to.tellp());
 
-	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	write_chunk_header(magic, uint64_t(from.size()) * sizeof(T), &to);
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
 
 
 template< typename T >
-void write_struct(std::string const &magic, T const &from, std::ostream *to_) {
+void write_struct(std::string const &magic, T const &from, std::ostream *to_, std::vector< ChunkTOCEntry > *toc = nullptr) {
 	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
+	if (toc) toc->emplace_back(magic, to.tellp());
+
+	write_chunk_header(magic, sizeof(T), &to);
+	to.write(reinterpret_cast< const char * >(&from), sizeof(T));
+}
+
+//write a chunk compressed with zlib (see above); read_chunk decompresses it transparently:
+template< typename T >
+void write_deflated_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_, std::vector< ChunkTOCEntry > *toc = nullptr, uint32_t block_size = 1 << 20) {
+	assert(magic.size() == 4);
+	assert(to_);
+	auto &to = *to_;
+
+	if (toc) toc->emplace_back(magic, to.tellp());
+
+	//keep blocks a whole number of elements, so they can be passed along by read_chunk_pieces:
+	block_size = std::max< uint32_t >(1, block_size / sizeof(T)) * sizeof(T);
+	write_deflated_chunk(magic, reinterpret_cast< char const * >(from.data()), uint64_t(from.size()) * sizeof(T), &to, block_size);
+}
+
+inline void write_toc(std::vector< ChunkTOCEntry > const &toc, std::ostream *to_) {
+	assert(to_);
+	auto &to = *to_;
+
+	uint64_t toc_offset = to.tellp();
+	write_chunk("toc0", toc, &to);
+	write_struct("tocp", toc_offset, &to);
+}
+
+//read the table of contents from the end of a file:
+// returns false (and leaves toc empty) if the file doesn't have one
+// note: leaves the stream positioned after the "toc0" chunk
+inline bool read_toc(std::istream &from, std::vector< ChunkTOCEntry > *toc_) {
+	assert(toc_);
+	auto &toc = *toc_;
+	toc.clear();
+
+	struct TOCFooter {
 		char magic[4] = {'\0', '\0', '\0', '\0'};
 		uint32_t size = 0;
+		uint64_t offset = 0;
 	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-	ChunkHeader header;
-	header.magic[0] = magic[0];
-	header.magic[1] = magic[1];
-	header.magic[2] = magic[2];
-	header.magic[3] = magic[3];
-	header.size = sizeof(T);
+	static_assert(sizeof(TOCFooter) == 16, "toc footer is packed");
 
-	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
-	to.write(reinterpret_cast< const char * >(&from), sizeof(T));
+	TOCFooter footer;
+	if (!from.seekg(-int64_t(sizeof(footer)), std::ios::end)) {
+		from.clear();
+		return false;
+	}
+	if (!from.read(reinterpret_cast< char * >(&footer), sizeof(footer))) {
+		from.clear();
+		return false;
+	}
+	if (std::string(footer.magic,4) != "tocp" || footer.size != sizeof(footer.offset)) {
+		return false;
+	}
+	if (!from.seekg(footer.offset)) {
+		throw std::runtime_error("Table of contents offset is out of range.");
+	}
+	read_chunk(from, "toc0", &toc);
+	return true;
+}
+
+//seek to the chunk with a given magic number (using a table of contents from read_toc):
+// returns false if there is no such chunk
+inline bool seek_chunk(std::istream &from, std::vector< ChunkTOCEntry > const &toc, std::string const &magic) {
+	assert(magic.size() == 4);
+	for (auto const &entry : toc) {
+		if (std::string(entry.magic,4) == magic) {
+			if (!from.seekg(entry.offset)) {
+				throw std::runtime_error("Chunk offset in table of contents is out of range.");
+			}
+			return true;
+		}
+	}
+	return false;
 }
@@ -0,0 +1,301 @@
+#include "rgbe.hpp"
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define RGBE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define RGBE_AVX2 1 //(compiled with a target attribute, used if the CPU supports it)
+#include <immintrin.h>
+#endif
+#endif
+
+//Both directions avoid ldexp / frexp by building powers of two from their bits.
+//Scaling by a power of two is exact unless the result is denormal, so:
+// - rgbe_to_float scales by 2^(a-128) in two (exact) halves, leaving one rounding -- the same one ldexp does.
+// - float_to_rgbe reads frexp's exponent from the bits of the (normal) max component; frexp(d)/d is then exactly 2^-e.
+
+namespace {
+	inline float power_of_two(int32_t e) { //(for e in [-126,127])
+		uint32_t bits = uint32_t(e + 127) << 23;
+		float ret;
+		std::memcpy(&ret, &bits, sizeof(ret));
+		return ret;
+	}
+
+	void rgbe_to_float_scalar(glm::u8vec4 const *in, glm::vec3 *out, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			glm::u8vec4 col = in[i];
+			if (col == glm::u8vec4(0,0,0,0)) {
+				out[i] = glm::vec3(0.0f);
+				continue;
+			}
+			int32_t h1 = col.a >> 1;
+			int32_t h2 = col.a - h1;
+			float s1 = power_of_two(h1 - 64);
+			float s2 = power_of_two(h2 - 64);
+			out[i] = glm::vec3(
+				((col.r + 0.5f) / 256.0f) * s1 * s2,
+				((col.g + 0.5f) / 256.0f) * s1 * s2,
+				((col.b + 0.5f) / 256.0f) * s1 * s2
+			);
+		}
+	}
+
+	void float_to_rgbe_scalar(glm::vec3 const *in, glm::u8vec4 *out, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			glm::vec3 col = in[i];
+			float d = std::max(col.r, std::max(col.g, col.b));
+			if (d <= 1e-32f) {
+				out[i] = glm::u8vec4(0,0,0,0);
+				continue;
+			}
+			uint32_t bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+			int32_t e = int32_t((bits >> 23) & 0xff) - 126;
+			if (e > 127) {
+				out[i] = glm::u8vec4(0xff, 0xff, 0xff, 0xff);
+				continue;
+			}
+			int32_t h1 = e >> 1;
+			float fac = (255.999f * power_of_two(-h1)) * power_of_two(h1 - e);
+			out[i] = glm::u8vec4(
+				std::max(0, int32_t(col.r * fac)),
+				std::max(0, int32_t(col.g * fac)),
+				std::max(0, int32_t(col.b * fac)),
+				e + 128
+			);
+		}
+	}
+
+	#if RGBE_SSE2
+	//interleave four pixels' worth of r,g,b into three registers of rgbr / gbrg / brgb:
+	inline void store_rgb(float *out, __m128 r, __m128 g, __m128 b) {
+		__m128 rg_lo = _mm_unpacklo_ps(r, g); //r0 g0 r1 g1
+		__m128 rg_hi = _mm_unpackhi_ps(r, g); //r2 g2 r3 g3
+		__m128 t = _mm_shuffle_ps(b, rg_lo, _MM_SHUFFLE(2,2,0,0)); //b0 b0 r1 r1
+		__m128 u = _mm_shuffle_ps(rg_lo, b, _MM_SHUFFLE(1,1,3,3)); //g1 g1 b1 b1
+		__m128 v = _mm_shuffle_ps(b, rg_hi, _MM_SHUFFLE(2,2,2,2)); //b2 b2 r3 r3
+		__m128 w = _mm_shuffle_ps(rg_hi, b, _MM_SHUFFLE(3,3,3,3)); //g3 g3 b3 b3
+		_mm_storeu_ps(out + 0, _mm_shuffle_ps(rg_lo, t, _MM_SHUFFLE(2,0,1,0)));
+		_mm_storeu_ps(out + 4, _mm_shuffle_ps(u, rg_hi, _MM_SHUFFLE(1,0,2,0)));
+		_mm_storeu_ps(out + 8, _mm_shuffle_ps(v, w, _MM_SHUFFLE(2,0,2,0)));
+	}
+
+	//the reverse of store_rgb:
+	inline void load_rgb(float const *in, __m128 *r, __m128 *g, __m128 *b) {
+		__m128 in0 = _mm_loadu_ps(in + 0); //r0 g0 b0 r1
+		__m128 in1 = _mm_loadu_ps(in + 4); //g1 b1 r2 g2
+		__m128 in2 = _mm_loadu_ps(in + 8); //b2 r3 g3 b3
+		*r = _mm_shuffle_ps(in0, _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+		*g = _mm_shuffle_ps(_mm_shuffle_ps(in0, in1, _MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+		*b = _mm_shuffle_ps(_mm_shuffle_ps(in0, in1, _MM_SHUFFLE(1,1,2,2)), _mm_shuffle_ps(in2, in2, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+	}
+
+	//2^e for each lane (e in [-126,127]):
+	inline __m128 power_of_two(__m128i e) {
+		return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+	}
+
+	size_t rgbe_to_float_sse2(glm::u8vec4 const *in, glm::vec3 *out, size_t count) {
+		__m128i const byte = _mm_set1_epi32(0xff);
+		__m128i const bias = _mm_set1_epi32(64);
+		__m128 const half = _mm_set1_ps(0.5f);
+		__m128 const inv256 = _mm_set1_ps(1.0f / 256.0f);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i p = _mm_loadu_si128(reinterpret_cast< __m128i const * >(in + i));
+			__m128i a = _mm_srli_epi32(p, 24);
+			__m128i h1 = _mm_srli_epi32(a, 1);
+			__m128i h2 = _mm_sub_epi32(a, h1);
+			__m128 s1 = power_of_two(_mm_sub_epi32(h1, bias));
+			__m128 s2 = power_of_two(_mm_sub_epi32(h2, bias));
+			__m128 zero = _mm_castsi128_ps(_mm_cmpeq_epi32(p, _mm_setzero_si128()));
+			auto channel = [&](int shift) {
+				__m128 c = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, shift), byte));
+				c = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(c, half), inv256), s1), s2);
+				return _mm_andnot_ps(zero, c);
+			};
+			store_rgb(&out[i].x, channel(0), channel(8), channel(16));
+		}
+		return i;
+	}
+
+	size_t float_to_rgbe_sse2(glm::vec3 const *in, glm::u8vec4 *out, size_t count) {
+		__m128 const min_value = _mm_set1_ps(1e-32f);
+		__m128 const scale = _mm_set1_ps(255.999f);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128 r, g, b;
+			load_rgb(&in[i].x, &r, &g, &b);
+			__m128 d = _mm_max_ps(r, _mm_max_ps(g, b));
+			__m128i e = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(_mm_castps_si128(d), 23), _mm_set1_epi32(0xff)), _mm_set1_epi32(126));
+			__m128i h1 = _mm_srai_epi32(e, 1);
+			__m128 fac = _mm_mul_ps(_mm_mul_ps(scale, power_of_two(_mm_sub_epi32(_mm_setzero_si128(), h1))), power_of_two(_mm_sub_epi32(h1, e)));
+			auto channel = [&](__m128 c) {
+				__m128i v = _mm_cvttps_epi32(_mm_mul_ps(c, fac));
+				return _mm_and_si128(v, _mm_cmpgt_epi32(v, _mm_setzero_si128())); //(max with zero)
+			};
+			__m128i px = _mm_or_si128(
+				_mm_or_si128(channel(r), _mm_slli_epi32(channel(g), 8)),
+				_mm_or_si128(_mm_slli_epi32(channel(b), 16), _mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(128)), 24))
+			);
+			__m128i small = _mm_castps_si128(_mm_cmple_ps(d, min_value));
+			__m128i large = _mm_cmpgt_epi32(e, _mm_set1_epi32(127));
+			px = _mm_or_si128(_mm_andnot_si128(small, px), large);
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(out + i), px);
+		}
+		return i;
+	}
+	#endif //RGBE_SSE2
+
+	#if RGBE_AVX2
+	__attribute__((target("avx2")))
+	inline __m256 power_of_two_avx2(__m256i e) {
+		return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e, _mm256_set1_epi32(127)), 23));
+	}
+
+	__attribute__((target("avx2")))
+	size_t rgbe_to_float_avx2(glm::u8vec4 const *in, glm::vec3 *out, size_t count) {
+		__m256i const byte = _mm256_set1_epi32(0xff);
+		__m256i const bias = _mm256_set1_epi32(64);
+		__m256 const half = _mm256_set1_ps(0.5f);
+		__m256 const inv256 = _mm256_set1_ps(1.0f / 256.0f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i p = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(in + i));
+			__m256i a = _mm256_srli_epi32(p, 24);
+			__m256i h1 = _mm256_srli_epi32(a, 1);
+			__m256i h2 = _mm256_sub_epi32(a, h1);
+			__m256 s1 = power_of_two_avx2(_mm256_sub_epi32(h1, bias));
+			__m256 s2 = power_of_two_avx2(_mm256_sub_epi32(h2, bias));
+			__m256 zero = _mm256_castsi256_ps(_mm256_cmpeq_epi32(p, _mm256_setzero_si256()));
+			__m256 c[3];
+			for (int k = 0; k < 3; ++k) {
+				__m256 v = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, 8 * k), byte));
+				v = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(v, half), inv256), s1), s2);
+				c[k] = _mm256_andnot_ps(zero, v);
+			}
+			store_rgb(&out[i].x, _mm256_castps256_ps128(c[0]), _mm256_castps256_ps128(c[1]), _mm256_castps256_ps128(c[2]));
+			store_rgb(&out[i+4].x, _mm256_extractf128_ps(c[0], 1), _mm256_extractf128_ps(c[1], 1), _mm256_extractf128_ps(c[2], 1));
+		}
+		return i;
+	}
+
+	__attribute__((target("avx2")))
+	size_t float_to_rgbe_avx2(glm::vec3 const *in, glm::u8vec4 *out, size_t count) {
+		__m256 const min_value = _mm256_set1_ps(1e-32f);
+		__m256 const scale = _mm256_set1_ps(255.999f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128 r0, g0, b0, r1, g1, b1;
+			load_rgb(&in[i].x, &r0, &g0, &b0);
+			load_rgb(&in[i+4].x, &r1, &g1, &b1);
+			__m256 r = _mm256_insertf128_ps(_mm256_castps128_ps256(r0), r1, 1);
+			__m256 g = _mm256_insertf128_ps(_mm256_castps128_ps256(g0), g1, 1);
+			__m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(b0), b1, 1);
+			__m256 d = _mm256_max_ps(r, _mm256_max_ps(g, b));
+			__m256i e = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(_mm256_castps_si256(d), 23), _mm256_set1_epi32(0xff)), _mm256_set1_epi32(126));
+			__m256i h1 = _mm256_srai_epi32(e, 1);
+			__m256 fac = _mm256_mul_ps(_mm256_mul_ps(scale, power_of_two_avx2(_mm256_sub_epi32(_mm256_setzero_si256(), h1))), power_of_two_avx2(_mm256_sub_epi32(h1, e)));
+			__m256i c[3];
+			__m256 rgb[3] = { r, g, b };
+			for (int k = 0; k < 3; ++k) {
+				c[k] = _mm256_max_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(rgb[k], fac)), _mm256_setzero_si256());
+			}
+			__m256i px = _mm256_or_si256(
+				_mm256_or_si256(c[0], _mm256_slli_epi32(c[1], 8)),
+				_mm256_or_si256(_mm256_slli_epi32(c[2], 16), _mm256_slli_epi32(_mm256_add_epi32(e, _mm256_set1_epi32(128)), 24))
+			);
+			__m256i small = _mm256_castps_si256(_mm256_cmp_ps(d, min_value, _CMP_LE_OQ));
+			__m256i large = _mm256_cmpgt_epi32(e, _mm256_set1_epi32(127));
+			px = _mm256_or_si256(_mm256_andnot_si256(small, px), large);
+			_mm256_storeu_si256(reinterpret_cast< __m256i * >(out + i), px);
+		}
+		return i;
+	}
+
+	bool has_avx2() {
+		static bool avx2 = __builtin_cpu_supports("avx2");
+		return avx2;
+	}
+	#endif //RGBE_AVX2
+}
+
+void rgbe_to_float(glm::u8vec4 const *in, glm::vec3 *out, size_t count) {
+	static_assert(sizeof(glm::u8vec4) == 4 && sizeof(glm::vec3) == 12, "pixel types are packed");
+	size_t done = 0;
+	#if RGBE_AVX2
+	if (has_avx2()) done = rgbe_to_float_avx2(in, out, count);
+	#endif
+	#if RGBE_SSE2
+	done += rgbe_to_float_sse2(in + done, out + done, count - done);
+	#endif
+	rgbe_to_float_scalar(in + done, out + done, count - done);
+}
+
+void float_to_rgbe(glm::vec3 const *in, glm::u8vec4 *out, size_t count) {
+	size_t done = 0;
+	#if RGBE_AVX2
+	if (has_avx2()) done = float_to_rgbe_avx2(in, out, count);
+	#endif
+	#if RGBE_SSE2
+	done += float_to_rgbe_sse2(in + done, out + done, count - done);
+	#endif
+	float_to_rgbe_scalar(in + done, out + done, count - done);
+}
+
+uint32_t float_to_rgb9e5(glm::vec3 col) {
+	constexpr int32_t N = 9; //mantissa bits
+	constexpr int32_t B = 15; //exponent bias
+	constexpr float Max = float((1 << N) - 1) / float(1 << N) * float(1 << (31 - B)); //65408
+
+	//clamp to representable range (also maps NaN to zero):
+	auto clamp = [&](float c) { return (c > 0.0f ? std::min(c, Max) : 0.0f); };
+	float r = clamp(col.r);
+	float g = clamp(col.g);
+	float b = clamp(col.b);
+	float m = std::max(r, std::max(g, b));
+
+	int32_t floor_log2 = -B - 1;
+	if (m > 0.0f) {
+		int e;
+		std::frexp(m, &e);
+		floor_log2 = std::max(floor_log2, e - 1);
+	}
+	int32_t exp = floor_log2 + 1 + B;
+	if (int32_t(std::floor(std::ldexp(m, N + B - exp) + 0.5f)) == (1 << N)) {
+		exp += 1;
+	}
+	auto mantissa = [&](float c) { return uint32_t(std::floor(std::ldexp(c, N + B - exp) + 0.5f)); };
+	return mantissa(r) | (mantissa(g) << 9) | (mantissa(b) << 18) | (uint32_t(exp) << 27);
+}
+
+glm::vec3 rgb9e5_to_float(uint32_t packed) {
+	int32_t exp = int32_t(packed >> 27) - 15 - 9;
+	return glm::vec3(
+		std::ldexp(float(packed & 0x1ff), exp),
+		std::ldexp(float((packed >> 9) & 0x1ff), exp),
+		std::ldexp(float((packed >> 18) & 0x1ff), exp)
+	);
+}
+
+void rgbe_to_rgb9e5(glm::u8vec4 const *in, uint32_t *out, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		glm::u8vec4 col = in[i];
+		//rgbe is (c + 0.5) * 2^(a - 136) == (2c + 1) * 2^((a - 113) - 15 - 9),
+		// so when the brightest channel uses all eight bits and a - 113 fits in five bits, rgbe maps directly:
+		uint32_t max = std::max(col.r, std::max(col.g, col.b));
+		if (max >= 128 && col.a >= 113 && col.a < 113 + 32) {
+			out[i] = (2U * col.r + 1U) | ((2U * col.g + 1U) << 9) | ((2U * col.b + 1U) << 18) | (uint32_t(col.a - 113) << 27);
+		} else if (col == glm::u8vec4(0,0,0,0)) {
+			out[i] = 0;
+		} else {
+			out[i] = float_to_rgb9e5(rgbe_to_float(col)); //(unnormalized, very dim, or very bright pixels)
+		}
+	}
+}
+
@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
 
 //see radiance source code at ray/src/common/color.c -- setcolr() function
 
@@ -42,3 +44,18 @@ inline glm::u8vec4 float_to_rgbe(glm::vec3 col) {
 		e + 128
 	);
 }
+
+//convert 'count' pixels at once (defined in rgbe.cpp):
+// gives the same results as the functions above (for finite inputs), but builds exponents directly
+// from float bits and uses SSE2 / AVX2 (when the CPU has it) on x86, so is much faster for whole images
+void rgbe_to_float(glm::u8vec4 const *in, glm::vec3 *out, size_t count);
+void float_to_rgbe(glm::vec3 const *in, glm::u8vec4 *out, size_t count);
+
+//GL_RGB9_E5 texels, packed as GL_UNSIGNED_INT_5_9_9_9_REV (r in the low nine bits, then g, b, and a five-bit exponent):
+// (float_to_rgb9e5 follows the conversion in the EXT_texture_shared_exponent spec)
+uint32_t float_to_rgb9e5(glm::vec3 col);
+glm::vec3 rgb9e5_to_float(uint32_t packed);
+
+//convert rgbe pixels directly to packed RGB9_E5 (same result as float_to_rgb9e5(rgbe_to_float(px))):
+// (both formats have a shared exponent, so this is mostly integer shifts)
+void rgbe_to_rgb9e5(glm::u8vec4 const *in, uint32_t *out, size_t count);
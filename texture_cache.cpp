@@ -0,0 +1,319 @@
+#include "texture_cache.hpp"
+#include "read_chunk.hpp"
+#include "path.hpp"
+#include "load_stats.hpp"
+
+#include <zlib.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace kit {
+
+bool use_texture_cache = true;
+
+namespace {
+	//stored in the "tex0" chunk of a cache entry:
+	struct TextureHeader {
+		uint32_t crc;
+		uint32_t reserved;
+		uint64_t source_size;
+		uint32_t target, internal_format, format, type;
+		uint32_t width, height;
+		uint32_t faces, levels;
+	};
+	static_assert(sizeof(TextureHeader) == 48, "TextureHeader is packed");
+
+	std::string cache_directory() {
+		static std::string directory = [](){
+			std::string path = user_path("texture-cache");
+			#if defined(_WIN32)
+			_mkdir(path.c_str());
+			#else
+			mkdir(path.c_str(), 0755);
+			#endif
+			return path;
+		}();
+		return directory;
+	}
+
+	//bytes per texel of (tightly packed) data in the given format and type, or 0 if not supported by the cache:
+	uint32_t texel_bytes(GLenum format, GLenum type) {
+		uint32_t components;
+		switch (format) {
+			case GL_RED: components = 1; break;
+			case GL_RG: components = 2; break;
+			case GL_RGB: components = 3; break;
+			case GL_RGBA: components = 4; break;
+			default: return 0;
+		}
+		switch (type) {
+			case GL_UNSIGNED_BYTE: return components;
+			case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2 * components;
+			case GL_FLOAT: return 4 * components;
+			case GL_UNSIGNED_INT_5_9_9_9_REV: case GL_UNSIGNED_INT_10F_11F_11F_REV: return (format == GL_RGB ? 4 : 0);
+			default: return 0;
+		}
+	}
+
+	std::string hex(uint64_t value, int digits) {
+		char buffer[17];
+		std::snprintf(buffer, sizeof(buffer), "%0*llx", digits, (unsigned long long)value);
+		return buffer;
+	}
+
+	//box-filter an RGBA8 image down to half size (rounding down, but at least one pixel):
+	std::vector< glm::u8vec4 > half_size(glm::uvec2 size, std::vector< glm::u8vec4 > const &from, glm::uvec2 *half_) {
+		assert(half_);
+		auto &half = *half_;
+		half = glm::max(size / 2U, glm::uvec2(1));
+		std::vector< glm::u8vec4 > to(half.x * half.y);
+		for (uint32_t y = 0; y < half.y; ++y) {
+			uint32_t y0 = std::min(2 * y, size.y - 1);
+			uint32_t y1 = std::min(2 * y + 1, size.y - 1);
+			for (uint32_t x = 0; x < half.x; ++x) {
+				uint32_t x0 = std::min(2 * x, size.x - 1);
+				uint32_t x1 = std::min(2 * x + 1, size.x - 1);
+				glm::uvec4 sum = glm::uvec4(from[y0 * size.x + x0]) + glm::uvec4(from[y0 * size.x + x1])
+				               + glm::uvec4(from[y1 * size.x + x0]) + glm::uvec4(from[y1 * size.x + x1]);
+				to[y * half.x + x] = glm::u8vec4((sum + glm::uvec4(2)) / 4U);
+			}
+		}
+		return to;
+	}
+}
+
+void CachedTexture::add_image(void const *data, size_t size_) {
+	std::memcpy(add_image(size_), data, size_);
+}
+
+uint8_t *CachedTexture::add_image(size_t size_) {
+	assert(!file); //(mapped textures are read-only)
+	Image image;
+	image.offset = storage.size();
+	image.size = size_;
+	storage.resize(storage.size() + size_);
+	images.emplace_back(image);
+	return storage.data() + image.offset;
+}
+
+void CachedTexture::upload(GLuint texture) const {
+	assert(images.size() == size_t(levels) * faces);
+	glBindTexture(target, texture);
+
+	//rows of, e.g., RGB8 data aren't padded to four bytes:
+	GLint alignment = 4;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (uint32_t level = 0; level < levels; ++level) {
+		glm::uvec2 level_size = glm::max(glm::uvec2(size.x >> level, size.y >> level), glm::uvec2(1));
+		for (uint32_t face = 0; face < faces; ++face) {
+			Image const &image = images[level * faces + face];
+			GLenum image_target = (target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target);
+			glTexImage2D(image_target, level, internal_format, level_size.x, level_size.y, 0, format, type, pixels() + image.offset);
+			count_gpu_bytes(image.size);
+		}
+	}
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, GLint(levels) - 1);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+std::string TextureCacheKey::filename() const {
+	uint32_t params_crc = crc32(0L, reinterpret_cast< Bytef const * >(params.data()), uInt(params.size()));
+	return cache_directory() + "/" + hex(crc, 8) + "-" + hex(size, 1) + "-" + hex(params_crc, 8) + ".tex";
+}
+
+TextureCacheKey texture_cache_key(std::string const &source, std::string const &params) {
+	TextureCacheKey key;
+	key.params = params;
+
+	std::ifstream from(source, std::ios::binary);
+	if (!from) {
+		throw std::runtime_error("Failed to open '" + source + "'.");
+	}
+	uLong crc = crc32(0L, Z_NULL, 0);
+	std::vector< char > buffer(1 << 20);
+	while (from) {
+		from.read(buffer.data(), buffer.size());
+		std::streamsize got = from.gcount();
+		if (got <= 0) break;
+		crc = crc32(crc, reinterpret_cast< Bytef const * >(buffer.data()), uInt(got));
+		key.size += uint64_t(got);
+	}
+	if (from.bad()) {
+		throw std::runtime_error("Failed to read '" + source + "'.");
+	}
+	count_bytes_read(key.size);
+	key.crc = uint32_t(crc);
+	return key;
+}
+
+bool load_cached_texture(TextureCacheKey const &key, CachedTexture *texture_) {
+	assert(texture_);
+	auto &texture = *texture_;
+	std::string filename = key.filename();
+	if (!std::ifstream(filename, std::ios::binary)) return false; //(no entry)
+
+	try {
+		std::unique_ptr< ChunkFile > file(new ChunkFile(filename));
+
+		auto params = file->read< char >("tck0");
+		if (std::string(params.begin(), params.end()) != key.params) return false; //(filename collision)
+
+		TextureHeader header;
+		file->read_struct("tex0", &header);
+		if (header.crc != key.crc || header.source_size != key.size) return false;
+
+		auto images = file->read< CachedTexture::Image >("img0");
+		ChunkView< uint8_t > pixels = file->read< uint8_t >("pix0");
+		//upload() trusts the header, so check that every image is as big as it says:
+		if (!((header.target == GL_TEXTURE_2D && header.faces == 1)
+		   || (header.target == GL_TEXTURE_CUBE_MAP && header.faces == 6 && header.width == header.height))) {
+			throw std::runtime_error("unsupported target or face count");
+		}
+		if (header.width == 0 || header.height == 0 || header.levels == 0 || header.levels > 32
+		 || (header.levels > 1 && std::max(header.width, header.height) >> (header.levels - 1) == 0)) {
+			throw std::runtime_error("bad size or level count");
+		}
+		uint32_t texel = texel_bytes(header.format, header.type);
+		if (texel == 0) {
+			throw std::runtime_error("unsupported format or type");
+		}
+		if (images.size() != size_t(header.levels) * header.faces) {
+			throw std::runtime_error("image count doesn't match levels and faces");
+		}
+		for (uint32_t level = 0; level < header.levels; ++level) {
+			uint64_t level_bytes = uint64_t(std::max(1U, header.width >> level)) * std::max(1U, header.height >> level) * texel;
+			for (uint32_t face = 0; face < header.faces; ++face) {
+				auto const &image = images[level * header.faces + face];
+				if (image.offset > pixels.size() || image.size > pixels.size() - image.offset) {
+					throw std::runtime_error("image is outside of pixel data");
+				}
+				if (image.size != level_bytes) {
+					throw std::runtime_error("image size doesn't match its level");
+				}
+			}
+		}
+
+		texture.target = header.target;
+		texture.internal_format = header.internal_format;
+		texture.format = header.format;
+		texture.type = header.type;
+		texture.size = glm::uvec2(header.width, header.height);
+		texture.faces = header.faces;
+		texture.levels = header.levels;
+		texture.images.assign(images.begin(), images.end());
+		texture.storage.clear();
+		texture.mapped = std::move(pixels);
+		texture.file = std::move(file);
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: ignoring texture cache entry '" << filename << "': " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void save_cached_texture(TextureCacheKey const &key, CachedTexture const &texture) {
+	assert(texture.images.size() == size_t(texture.levels) * texture.faces);
+	std::string filename = key.filename();
+
+	TextureHeader header;
+	header.crc = key.crc;
+	header.reserved = 0;
+	header.source_size = key.size;
+	header.target = texture.target;
+	header.internal_format = texture.internal_format;
+	header.format = texture.format;
+	header.type = texture.type;
+	header.width = texture.size.x;
+	header.height = texture.size.y;
+	header.faces = texture.faces;
+	header.levels = texture.levels;
+
+	//write to a temporary file and rename it into place, so other loads never see a partial entry:
+	std::ostringstream thread_id;
+	thread_id << std::this_thread::get_id();
+	std::string temporary = filename + ".tmp" + thread_id.str();
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		write_chunk("tck0", std::vector< char >(key.params.begin(), key.params.end()), &out);
+		write_struct("tex0", header, &out);
+		write_chunk("img0", texture.images, &out);
+		write_chunk_header("pix0", texture.pixels_size(), &out);
+		out.write(reinterpret_cast< char const * >(texture.pixels()), texture.pixels_size());
+		if (!out) {
+			std::cerr << "WARNING: failed to write texture cache entry '" << temporary << "'." << std::endl;
+			out.close();
+			std::remove(temporary.c_str());
+			return;
+		}
+	}
+	#if defined(_WIN32)
+	std::remove(filename.c_str()); //(rename won't replace files on windows)
+	#endif
+	if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+		std::cerr << "WARNING: failed to move texture cache entry into place at '" << filename << "'." << std::endl;
+		std::remove(temporary.c_str());
+	}
+}
+
+CachedTexture cached_texture(std::string const &source, std::string const &params, std::function< void(CachedTexture *) > const &make) {
+	CachedTexture texture;
+	if (!use_texture_cache) {
+		make(&texture);
+		return texture;
+	}
+	TextureCacheKey key = texture_cache_key(source, params);
+	if (load_cached_texture(key, &texture)) return texture;
+
+	texture = CachedTexture();
+	make(&texture);
+	save_cached_texture(key, texture);
+	return texture;
+}
+
+CachedTexture load_png_cached(std::string const &filename, OriginLocation origin, bool mipmaps) {
+	std::string params = "png rgba8";
+	params += (origin == LowerLeftOrigin ? " lower-left" : " upper-left");
+	if (mipmaps) params += " mipmaps";
+
+	return cached_texture(filename, params, [&](CachedTexture *texture) {
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > data;
+		{
+			std::vector< uint32_t > pixels;
+			if (!load_png(filename, &size.x, &size.y, &pixels, origin)) {
+				throw std::runtime_error("Failed to load '" + filename + "' as png.");
+			}
+			glm::u8vec4 const *begin = reinterpret_cast< glm::u8vec4 const * >(pixels.data());
+			data.assign(begin, begin + pixels.size());
+		}
+		texture->size = size;
+		texture->levels = 1;
+		texture->add_image(data.data(), data.size() * 4);
+		while (mipmaps && (size.x > 1 || size.y > 1)) {
+			glm::uvec2 half;
+			data = half_size(size, data, &half);
+			size = half;
+			texture->levels += 1;
+			texture->add_image(data.data(), data.size() * 4);
+		}
+	});
+}
+
+}
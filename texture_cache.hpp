@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+ * A disk cache of decoded, GPU-ready textures (pixel format, every mip level, and
+ *  any format conversion already applied), stored in chunk files under
+ *  kit::user_path("texture-cache/").
+ *
+ * Entries are keyed by a hash of the source file's contents (plus its size) and a
+ *  string describing how it was converted, so editing the source or changing the
+ *  conversion makes a new entry rather than reusing a stale one:
+ *
+ *   kit::CachedTexture texture = kit::cached_texture(filename, "rgba8 mipmaps", [&](kit::CachedTexture *make) {
+ *       ...decode 'filename' and fill in *make (only called on a cache miss)...
+ *   });
+ *   texture.upload(tex); //(main thread)
+ *
+ * Cache files are read with ChunkFile (i.e., mapped), and uploaded straight from the mapping.
+ * Everything except upload() is safe to call from worker threads.
+ *
+ * The cache is best-effort: failing to read or write an entry prints a warning and
+ *  falls back to decoding the source.
+ */
+
+#include "gl.hpp"
+#include "ChunkFile.hpp"
+#include "load_save_png.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace kit {
+
+extern bool use_texture_cache; //set to false to always decode from the source (default is true)
+
+//texture data in the form glTexImage2D wants it:
+struct CachedTexture {
+	GLenum target = GL_TEXTURE_2D; //or GL_TEXTURE_CUBE_MAP
+	GLenum internal_format = GL_RGBA8;
+	GLenum format = GL_RGBA;
+	GLenum type = GL_UNSIGNED_BYTE;
+	glm::uvec2 size = glm::uvec2(0); //size of level zero (of each face)
+	uint32_t faces = 1; //6 for cube maps, in the order +x,-x,+y,-y,+z,-z
+	uint32_t levels = 1;
+
+	//the pixels of level l, face f are pixels() + images[l * faces + f].offset:
+	struct Image {
+		uint64_t offset = 0;
+		uint64_t size = 0;
+	};
+	std::vector< Image > images;
+
+	//append the next image (level-major, faces within levels):
+	void add_image(void const *data, size_t size);
+	//...or append space for it, and return where to write it (valid until storage reallocates):
+	uint8_t *add_image(size_t size);
+
+	uint8_t const *pixels() const { return file ? mapped.data() : storage.data(); }
+	uint64_t pixels_size() const { return file ? mapped.size() : storage.size(); }
+
+	//upload every image to 'texture' (and set GL_TEXTURE_MAX_LEVEL to match); leaves the texture bound:
+	void upload(GLuint texture) const;
+
+	//internals:
+	std::vector< uint8_t > storage; //pixels for a freshly made texture
+	std::unique_ptr< ChunkFile > file; //or the mapped cache file holding them
+	ChunkView< uint8_t > mapped;
+};
+
+struct TextureCacheKey {
+	uint32_t crc = 0; //crc32 of source contents
+	uint64_t size = 0; //size of source
+	std::string params; //how the source was converted
+	std::string filename() const; //where the entry lives
+};
+
+//hash a source file (throws if it can't be read):
+TextureCacheKey texture_cache_key(std::string const &source, std::string const &params);
+
+//read a cached texture; returns false if there is no (valid) entry for the key:
+bool load_cached_texture(TextureCacheKey const &key, CachedTexture *texture);
+
+//write a cached texture (failures are warnings):
+void save_cached_texture(TextureCacheKey const &key, CachedTexture const &texture);
+
+//return the cached texture for 'source' + 'params', calling 'make' and caching its result on a miss:
+CachedTexture cached_texture(std::string const &source, std::string const &params, std::function< void(CachedTexture *) > const &make);
+
+//load a png as an RGBA8 texture (with a full chain of box-filtered mipmaps, if 'mipmaps' is set), through the cache:
+CachedTexture load_png_cached(std::string const &filename, OriginLocation origin, bool mipmaps = true);
+
+}